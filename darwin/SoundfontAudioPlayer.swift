@@ -15,6 +15,8 @@ struct ChordEvent {
     let velocity: Int
     let timestamp: Double
     let duration: Double
+    // the chord's event in the sequencer unit, nil until it has been added there
+    var handle: MIDIEventHandle? = nil
 }
 
 class SoundfontAudioPlayer {
@@ -25,8 +27,11 @@ class SoundfontAudioPlayer {
     private var realTimeSequencer: RealTimeSequencer!
     
     private var repeating: Bool = false
+    private var sequencerRunning: Bool = false
     
     private var midiNode: AVAudioUnit?
+    
+    private var outputRecorder: SequencerOutputRecorder?
 
     private var midiIn = MidiSource()
     
@@ -91,6 +96,15 @@ class SoundfontAudioPlayer {
                 self.audioEngine.attach(audiounit!)
                 
                 self.midiNode = audiounit!
+                self.sequencerUnit?.setTempo(newTempo)
+                
+                // the chords play from the unit's first track, in place of its demo notes
+                self.sequencerUnit?.setEvents(nil, count: 0, handles: nil)
+                self.sequencerUnit?.setLength(8)
+                self.sequencerUnit?.setGated(!self.sequencerRunning)
+                for index in self.chords.indices {
+                    self.chords[index].handle = self.addToSequencer(self.chords[index])
+                }
                 
 //                audiounit?.auAudioUnit.musicalContextBlock = { [weak self] _, _, _, _, _, _ in
 //                    return false
@@ -122,6 +136,23 @@ class SoundfontAudioPlayer {
             print("Error starting audio engine: \(error.localizedDescription)")
         }
         
+        // the recorder's tap stays on the output unit, starting a recording only opens a file
+        if let outputUnit = audioEngine.outputNode.audioUnit {
+            do {
+                outputRecorder = try SequencerOutputRecorder(outputUnit: outputUnit, bufferDuration: 2.0)
+            } catch {
+                print("Error attaching output recorder: \(error.localizedDescription)")
+            }
+        }
+        NotificationCenter.default.addObserver(forName: .AVAudioEngineConfigurationChange, object: audioEngine, queue: .main) { [weak self] _ in
+            guard let self, let outputUnit = self.audioEngine.outputNode.audioUnit else { return }
+            do {
+                try self.outputRecorder?.reattach(toOutputUnit: outputUnit)
+            } catch {
+                print("Error reattaching output recorder, recording stopped: \(error.localizedDescription)")
+            }
+        }
+        
         midiIn.callback = self.handleEvent
     }
     
@@ -154,8 +185,11 @@ class SoundfontAudioPlayer {
         }
     }
     
+    // stopped, the chords only play while a note is held in repeating mode
     func startSequencer() {
-        musicSequencer.play()
+        sequencerRunning = true
+        sequencerUnit?.setGated(false)
+        sequencerUnit?.restart()
 //        do {
 //            try sequencer.start()
 //        } catch {
@@ -164,16 +198,32 @@ class SoundfontAudioPlayer {
     }
     
     func stopSequencer() {
-        musicSequencer.stop()
+        sequencerRunning = false
+        sequencerUnit?.setGated(true)
         //sequencer.stop()
     }
     
+    func startRecording(path: String) -> Bool {
+        guard let outputRecorder else { return false }
+        do {
+            try outputRecorder.startRecording(to: URL(fileURLWithPath: path))
+            return true
+        } catch {
+            print("Error starting recording: \(error.localizedDescription)")
+            return false
+        }
+    }
+    
+    func stopRecording() {
+        outputRecorder?.stopRecording()
+    }
+    
     var sequencerUnit: SequencerAudioUnit? {
         return (midiNode?.auAudioUnit as? SequencerAudioUnit)
     }
     
     var isPlaying: Bool {
-        musicSequencer.isPlaying
+        sequencerRunning
         //sequencer.isPlaying
     }
     
@@ -207,17 +257,10 @@ class SoundfontAudioPlayer {
     
     func addChord(_ chord: ChordEvent) {
         removeChord(chord)
+        var chord = chord
+        chord.handle = addToSequencer(chord)
         chords.append(chord)
         
-        for note in chord.notes {
-            musicSequencer.tracks[0].add(
-                noteNumber: UInt8(chord.root + note),
-                velocity: UInt8(100),
-                position: Duration(beats: chord.timestamp),
-                duration: Duration(beats:chord.duration)
-            )
-        }
-        
 //        if #available(iOS 16.0, *) {
 //            let track = sequencer.tracks[0]
 //            for note in chord.notes {
@@ -237,14 +280,33 @@ class SoundfontAudioPlayer {
             return ch.timestamp == chord.timestamp && ch.duration == chord.duration
         })
         if let foundChord {
+            if let handle = chords[foundChord].handle {
+                _ = sequencerUnit?.deleteEvent(handle)
+            }
             chords.remove(at: foundChord)
             
-            musicSequencer.tracks[0].clearRange(start: Duration(beats:chord.timestamp), duration: Duration(beats: chord.duration))
-            
 //            let track = sequencer.tracks[0]
 //            if #available(iOS 16.0, *) {
 //                track.clearEvents(in: AVBeatRange(start: chord.timestamp, length: chord.duration))
 //            }
         }
     }
+    
+    // a single chord event however many notes it has, the notes as intervals above the root
+    private func addToSequencer(_ chord: ChordEvent) -> MIDIEventHandle? {
+        guard let sequencerUnit else { return nil }
+        let intervals = chord.notes.reduce(UInt32(0)) { mask, note in
+            (0..<32).contains(note) ? mask | (UInt32(1) << UInt32(note)) : mask
+        }
+        // an empty chord would play its root as a lone note on
+        guard intervals != 0 else { return nil }
+        let event = MIDIChordEvent(
+            timestamp: chord.timestamp,
+            duration: chord.duration,
+            root: UInt8(clamping: chord.root),
+            velocity: UInt8(clamping: chord.velocity),
+            intervals: intervals
+        )
+        return sequencerUnit.addChord(event, track: 0)
+    }
 }
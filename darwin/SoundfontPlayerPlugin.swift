@@ -87,6 +87,13 @@ public class SoundfontPlayerPlugin: NSObject, FlutterPlugin {
         
     case "getPlayheadPosition":
         result(soundfontAudioPlayer.playheadPosition)
+    case "startRecording":
+        let args = call.arguments as? [String: Any] ?? [:]
+        let path = args["path"] as! String
+        result(soundfontAudioPlayer.startRecording(path: path))
+    case "stopRecording":
+        soundfontAudioPlayer.stopRecording()
+        result(nil)
     default:
       result(FlutterMethodNotImplemented)
     }
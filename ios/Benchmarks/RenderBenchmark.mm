@@ -0,0 +1,158 @@
+//
+//  RenderBenchmark.mm
+//  AUv3SequencerExample
+//
+//  Created by rumori on 2026. 10. 17..
+//
+//  Times the sequencer's render callback in each of its render modes, both through the function compiled for
+//  the mode and through the baseline that branches on the mode at run time, and SequenceScheduler on its own
+//  with and without looping. Not part of the plugin, build and run it on a Mac from the repository root with
+//
+//    clang++ -std=c++17 -O2 -fobjc-arc -I ios/Classes -x objective-c++ ios/Benchmarks/RenderBenchmark.mm -x c ios/Classes/TPCircularBuffer.c -framework AVFoundation -framework AudioToolbox -framework CoreMIDI -o RenderBenchmark
+//    ./RenderBenchmark
+//
+//  Every figure is the best average over BATCHES batches of BUFFERS callbacks, the one least disturbed
+//  by whatever else the machine is doing. Results are in README.md.
+//
+
+// compiles the kernel's runtime mode baseline, see RuntimeModePolicy
+#define SEQUENCER_RENDER_BASELINE 1
+
+#import "SequencerAudioUnit.h"
+#import "SequencerKernel.hpp"
+#import <chrono>
+#import <stdio.h>
+
+static constexpr int BATCHES = 2000;
+static constexpr int BUFFERS = 500;
+static constexpr uint32_t TRACKS = 4;
+static constexpr int EVENTS_PER_TRACK = 128;
+static constexpr double SAMPLE_RATE = 48000.0;
+
+// `run()` once per callback, returns nanoseconds per callback
+template <typename Prepare, typename Run>
+static double bestTime(Prepare &&prepare, Run &&run) {
+    double best = 1e12;
+    for (int batch = 0; batch < BATCHES; batch++) {
+        prepare();
+        auto start = std::chrono::steady_clock::now();
+        for (int i = 0; i < BUFFERS; i++) {
+            run();
+        }
+        double nanoseconds = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() / BUFFERS;
+        best = std::min(best, nanoseconds);
+    }
+    return best;
+}
+
+// note on and note off pairs spread over a 4 beat loop
+template <typename Add>
+static void addPattern(Add &&add) {
+    for (uint32_t track = 0; track < TRACKS; track++) {
+        for (int i = 0; i < EVENTS_PER_TRACK / 2; i++) {
+            double beat = i * 4.0 / (EVENTS_PER_TRACK / 2);
+            uint8_t note = (uint8_t)(40 + (i + track * 7) % 40);
+            add(MIDIEvent { beat, NOTE_ON, note, 100 }, track);
+            add(MIDIEvent { beat + 0.03, NOTE_OFF, note, 0 }, track);
+        }
+    }
+}
+
+// with `runtimeMode` through the baseline that branches on the mode, otherwise through the function compiled for it
+static double timeKernel(uint32_t mode, uint32_t frames, bool runtimeMode, long &events) {
+    SequencerKernel kernel;
+    kernel.initialize(SAMPLE_RATE);
+    events = 0;
+    kernel.setMIDIOutputEventBlock([&events](AUEventSampleTime, uint8_t, NSInteger, const uint8_t *) -> AUAudioUnitStatus {
+        events++;
+        return noErr;
+    });
+    double beatPosition = 0.0;
+    kernel.setMusicalContextBlock([&beatPosition](double *tempo, double *, NSInteger *, double *currentBeatPosition, NSInteger *, double *) -> BOOL {
+        if (tempo) *tempo = 120.0;
+        if (currentBeatPosition) *currentBeatPosition = beatPosition;
+        return YES;
+    });
+    kernel.setTransportStateBlock([](AUHostTransportStateFlags *flags, double *, double *, double *) -> BOOL {
+        *flags = AUHostTransportStateMoving;
+        return YES;
+    });
+    kernel.beginEdit();
+    kernel.setEvents(nullptr, 0, nullptr);
+    kernel.setTrackCount(TRACKS);
+    addPattern([&](const MIDIEvent &event, uint32_t track) { kernel.addEvent(event, track); });
+    kernel.endEdit();
+    kernel.flushEdits();
+    kernel.setInternalClock(mode & SEQUENCER_RENDER_INTERNAL_CLOCK);
+    kernel.setLooping(mode & SEQUENCER_RENDER_LOOPING);
+    kernel.setGated(mode & SEQUENCER_RENDER_GATED);
+    kernel.setHeldNote(60);
+
+    AudioTimeStamp timestamp = {};
+    return bestTime([&] {
+        // a one-shot pass would be over after the first batch
+        kernel.restart();
+        beatPosition = 0.0;
+    }, [&] {
+        if (runtimeMode) {
+            kernel.processWithRuntimeMode(nullptr, &timestamp, frames, 0, nullptr, nullptr, nullptr);
+        } else {
+            kernel.processWithEvents(nullptr, &timestamp, frames, 0, nullptr, nullptr, nullptr);
+        }
+        timestamp.mSampleTime += frames;
+        beatPosition += frames / SAMPLE_RATE * 2.0;
+    });
+}
+
+static void benchmarkKernel(uint32_t frames) {
+    static const char *const clockNames[] = { "host", "internal" };
+    static const char *const loopNames[] = { "one-shot", "looping" };
+    static const char *const gateNames[] = { "free-running", "gated" };
+    for (uint32_t mode = 0; mode < SEQUENCER_RENDER_MODE_COUNT; mode++) {
+        long events = 0;
+        long runtimeEvents = 0;
+        double compiled = timeKernel(mode, frames, false, events);
+        double runtime = timeKernel(mode, frames, true, runtimeEvents);
+        printf("render %4u frames  %-8s %-8s %-12s %8.1f ns compiled %8.1f ns runtime %+6.1f%% (%ld/%ld events)\n", frames,
+               clockNames[(mode & SEQUENCER_RENDER_INTERNAL_CLOCK) ? 1 : 0], loopNames[(mode & SEQUENCER_RENDER_LOOPING) ? 1 : 0],
+               gateNames[(mode & SEQUENCER_RENDER_GATED) ? 1 : 0], compiled, runtime, (runtime / compiled - 1.0) * 100.0, events, runtimeEvents);
+    }
+}
+
+template <bool Looping>
+static void benchmarkScheduler(uint32_t frames) {
+    EventSlotMap slots;
+    addPattern([&](const MIDIEvent &event, uint32_t track) { slots.add(event, track); });
+    std::shared_ptr<MIDISequence> sequence = std::make_shared<MIDISequence>();
+    sequence->assign(slots, std::vector<TrackSettings>(TRACKS));
+    sequence->revision = 1;
+    PatternBank bank;
+    bank.setPattern(0, sequence);
+    TempoMap tempoMap(120.0, SEQUENCER_PPQN);
+    GrooveTemplate groove;
+
+    SequenceScheduler scheduler;
+    InternalClock clock;
+    uint64_t frame = 0;
+    long events = 0;
+    double nanoseconds = bestTime([&] {
+        clock = InternalClock();
+        frame = 0;
+    }, [&] {
+        ClockWindow window = clock.advance(tempoMap, frame, frames, SAMPLE_RATE);
+        scheduler.schedule<Looping>(bank, groove, window, clock.pattern, [&events](const TickEvent &, double) { events++; });
+        frame += frames;
+    });
+    printf("schedule %4u frames  %-8s %8.1f ns per window (%ld events)\n", frames, Looping ? "looping" : "one-shot", nanoseconds, events);
+}
+
+int main() {
+    for (uint32_t frames : { 64u, 256u, 1024u }) {
+        benchmarkScheduler<true>(frames);
+        benchmarkScheduler<false>(frames);
+    }
+    for (uint32_t frames : { 64u, 256u, 1024u }) {
+        benchmarkKernel(frames);
+    }
+    return 0;
+}
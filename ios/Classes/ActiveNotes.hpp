@@ -0,0 +1,80 @@
+//
+//  ActiveNotes.hpp
+//  AUv3SequencerExample
+//
+//  Created by rumori on 2026. 10. 17..
+//
+
+#pragma once
+
+#ifdef __cplusplus
+
+#import <stddef.h>
+#import <stdint.h>
+
+// The notes the sequencer has started and not stopped yet, one 128-bit set per cable and channel.
+// Releasing them walks only the set bits (count trailing zeros), so a flush costs one note off per
+// sounding note instead of an all-notes-off sweep over every channel.
+template <size_t CABLES>
+class ActiveNotes {
+public:
+    static constexpr size_t CHANNELS = CABLES * 16;
+    static_assert(CHANNELS <= 64, "channels are addressed with a 64-bit mask");
+
+    // the bit standing for `channel` of `cable` in a channel mask
+    static uint64_t channelBit(uint8_t cable, uint8_t channel) {
+        return 1ull << slot(cable, channel);
+    }
+
+    static constexpr uint64_t allChannels() {
+        return CHANNELS == 64 ? ~0ull : (1ull << CHANNELS) - 1;
+    }
+
+    void noteOn(uint8_t cable, uint8_t channel, uint8_t note) {
+        size_t index = slot(cable, channel);
+        mNotes[index][(note >> 6) & 1] |= 1ull << (note & 63);
+        mSounding |= 1ull << index;
+    }
+
+    // returns false when the note was not sounding
+    bool noteOff(uint8_t cable, uint8_t channel, uint8_t note) {
+        size_t index = slot(cable, channel);
+        uint64_t &word = mNotes[index][(note >> 6) & 1];
+        uint64_t bit = 1ull << (note & 63);
+        if (!(word & bit)) return false;
+        word &= ~bit;
+        if (!(mNotes[index][0] | mNotes[index][1])) mSounding &= ~(1ull << index);
+        return true;
+    }
+
+    // Calls `release(cable, channel, note)` for every sounding note on the channels in `channelMask`, and forgets them.
+    template <typename Release>
+    void flush(uint64_t channelMask, Release &&release) {
+        uint64_t channels = mSounding & channelMask;
+        while (channels) {
+            size_t index = __builtin_ctzll(channels);
+            channels &= channels - 1;
+            for (size_t half = 0; half < 2; half++) {
+                uint64_t notes = mNotes[index][half];
+                while (notes) {
+                    uint8_t note = (uint8_t)(half * 64 + __builtin_ctzll(notes));
+                    notes &= notes - 1;
+                    release((uint8_t)(index / 16), (uint8_t)(index % 16), note);
+                }
+                mNotes[index][half] = 0;
+            }
+            mSounding &= ~(1ull << index);
+        }
+    }
+
+private:
+    static size_t slot(uint8_t cable, uint8_t channel) {
+        return (cable % CABLES) * 16 + (channel & 0x0F);
+    }
+
+    uint64_t mNotes[CHANNELS][2] = {};
+    // channels with at least one sounding note
+    uint64_t mSounding = 0;
+};
+
+#endif
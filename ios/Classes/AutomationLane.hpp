@@ -0,0 +1,60 @@
+//
+//  AutomationLane.hpp
+//  AUv3SequencerExample
+//
+//  Created by rumori on 2026. 10. 17..
+//
+
+#pragma once
+
+#ifdef __cplusplus
+
+#import <algorithm>
+#import <math.h>
+#import <stdint.h>
+#import <vector>
+
+// the most automation lanes a pattern can hold, so the scheduler can keep per-lane state in fixed arrays
+static constexpr size_t SEQUENCER_MAX_AUTOMATION_LANES = 64;
+
+// One breakpoint of a lane on the tick timeline, `value` from 0 to 1
+struct AutomationBreakpoint {
+    int64_t tick;
+    double value;
+};
+
+// A controller, pitch bend or velocity curve over a track's loop, stored as breakpoints with straight
+// lines between them. Nothing is expanded ahead of time: the scheduler samples the curve while it plays
+// and only sends a message when the value it would send changes, at most `maxRate` times a second.
+struct AutomationLane {
+    uint32_t track = 0;
+    // a controller number, SEQUENCER_AUTOMATION_PITCH_BEND or SEQUENCER_AUTOMATION_VELOCITY
+    uint16_t target = 0;
+    double maxRate = 200.0;
+    // sorted by tick
+    std::vector<AutomationBreakpoint> points;
+    // taken from the track when the pattern is published
+    uint8_t channel = 0;
+    uint8_t cable = 0;
+
+    // the curve at `tick`, holding the first and last values before and after them
+    double valueAt(double tick) const {
+        if (points.empty()) return 0.0;
+        auto next = std::upper_bound(points.begin(), points.end(), tick, [](double tick, const AutomationBreakpoint &point) {
+            return tick < point.tick;
+        });
+        if (next == points.begin()) return next->value;
+        auto previous = next - 1;
+        if (next == points.end() || next->tick == previous->tick) return previous->value;
+        double position = (tick - previous->tick) / (double)(next->tick - previous->tick);
+        return previous->value + (next->value - previous->value) * position;
+    }
+
+    // the data a message would carry at `value`: 7 bits for a controller, 14 for pitch bend
+    int32_t quantize(double value) const {
+        value = std::min(std::max(value, 0.0), 1.0);
+        return (int32_t)lround(value * (target == SEQUENCER_AUTOMATION_PITCH_BEND ? 16383.0 : 127.0));
+    }
+};
+
+#endif
@@ -1 +1,2 @@
-#include "SequencerAudioUnit.h"
\ No newline at end of file
+#include "SequencerAudioUnit.h"
+#include "SequencerOutputRecorder.h"
\ No newline at end of file
@@ -0,0 +1,184 @@
+//
+//  CommandQueue.hpp
+//  AUv3SequencerExample
+//
+//  Created by rumori on 2026. 10. 17..
+//
+
+#pragma once
+
+#ifdef __cplusplus
+
+#import <algorithm>
+#import <atomic>
+#import <chrono>
+#import <stdint.h>
+#import <type_traits>
+#import "TPCircularBuffer.h"
+
+// Occupancy and losses of one queue, for sizing it per device and for noticing commands going missing
+struct QueueStats {
+    uint32_t capacity = 0;
+    // commands waiting now, and the most that ever waited at once
+    uint32_t fill = 0;
+    uint32_t highWater = 0;
+    uint64_t pushed = 0;
+    // commands a producer gave up on because the queue was full
+    uint64_t dropped = 0;
+    // how long the oldest waiting command sat in the queue before a drain took it, in seconds
+    double lastDrainLatency = 0.0;
+    double maxDrainLatency = 0.0;
+};
+
+// A single-producer single-consumer queue of fixed-size commands over TPCircularBuffer.
+// The buffer's mirrored mapping keeps every free and every filled region contiguous, so the producer
+// writes commands straight into the ring and the consumer reads them where they are.
+// Publishing any number of commands is one atomic add, taking them is one atomic read and one atomic add.
+// The statistics are relaxed counters that only their own side writes, so keeping them costs no extra atomic operations.
+template <typename T>
+class CommandQueue {
+public:
+    static_assert(std::is_trivially_copyable<T>::value, "commands are copied as bytes");
+
+    // room for at least `capacity` commands, rounded up to whole pages
+    explicit CommandQueue(uint32_t capacity) {
+        TPCircularBufferInit(&mBuffer, capacity * (uint32_t)sizeof(T));
+    }
+
+    ~CommandQueue() {
+        TPCircularBufferCleanup(&mBuffer);
+    }
+
+    CommandQueue(const CommandQueue &) = delete;
+    CommandQueue &operator=(const CommandQueue &) = delete;
+
+    // Producer. The free space as a span of `count` commands, write them in place and commit
+    // as many as were written. Nothing is visible to the consumer before the commit.
+    T *reserve(uint32_t &count) {
+        uint32_t availableBytes;
+        T *head = (T *)TPCircularBufferHead(&mBuffer, &availableBytes);
+        count = head ? availableBytes / (uint32_t)sizeof(T) : 0;
+        return count > 0 ? head : nullptr;
+    }
+
+    // producer, publishes the first `count` commands of the last reserved span
+    void commit(uint32_t count) {
+        if (count == 0) return;
+        // the queue was empty, the next drain's latency counts from here
+        if (mBuffer.fillCount == 0) {
+            mPendingSince.store(now(), std::memory_order_relaxed);
+        }
+        TPCircularBufferProduce(&mBuffer, count * (uint32_t)sizeof(T));
+
+        uint32_t fill = (uint32_t)mBuffer.fillCount / (uint32_t)sizeof(T);
+        if (fill > mHighWater.load(std::memory_order_relaxed)) {
+            mHighWater.store(fill, std::memory_order_relaxed);
+        }
+        mPushed.store(mPushed.load(std::memory_order_relaxed) + count, std::memory_order_relaxed);
+    }
+
+    // producer, all or nothing: returns false and counts the commands as dropped when they do not fit
+    bool push(const T *commands, uint32_t count) {
+        if (tryPush(commands, count)) return true;
+        markDropped(count);
+        return false;
+    }
+
+    bool push(const T &command) {
+        return push(&command, 1);
+    }
+
+    // Producer, never blocks. Like push, but a producer that gets false still owns the commands and
+    // means to retry, so nothing is counted as dropped; instead the space available callback fires
+    // after the next drain that frees room.
+    bool tryPush(const T *commands, uint32_t count) {
+        uint32_t available;
+        T *head = reserve(available);
+        if (available < count) {
+            mSpaceWanted.store(true);
+            // a drain that finished before the flag was up will not call back, so look once more
+            head = reserve(available);
+            if (available < count) return false;
+        }
+        std::copy(commands, commands + count, head);
+        commit(count);
+        return true;
+    }
+
+    bool tryPush(const T &command) {
+        return tryPush(&command, 1);
+    }
+
+    // producer, counts commands it gave up on without pushing, e.g. when reserve came back empty
+    void markDropped(uint32_t count = 1) {
+        mDropped.store(mDropped.load(std::memory_order_relaxed) + count, std::memory_order_relaxed);
+    }
+
+    // Called on the consumer's thread after a drain frees room that a failed tryPush was waiting for.
+    // Set before either side starts; on a render thread consumer it must be real-time safe, e.g. signal a semaphore.
+    void setSpaceAvailableCallback(void (*callback)(void *context), void *context) {
+        mSpaceAvailable = callback;
+        mSpaceAvailableContext = context;
+    }
+
+    // any thread
+    QueueStats stats() const {
+        QueueStats stats;
+        stats.capacity = mBuffer.length / (uint32_t)sizeof(T);
+        stats.fill = (uint32_t)mBuffer.fillCount / (uint32_t)sizeof(T);
+        stats.highWater = mHighWater.load(std::memory_order_relaxed);
+        stats.pushed = mPushed.load(std::memory_order_relaxed);
+        stats.dropped = mDropped.load(std::memory_order_relaxed);
+        stats.lastDrainLatency = mLastLatency.load(std::memory_order_relaxed) * 1e-9;
+        stats.maxDrainLatency = mMaxLatency.load(std::memory_order_relaxed) * 1e-9;
+        return stats;
+    }
+
+    // Consumer. Calls `process(commands, count)` once with every command published so far,
+    // and releases them when it returns. Returns the number of commands.
+    template <typename Process>
+    uint32_t drain(Process &&process) {
+        uint32_t availableBytes;
+        const T *tail = (const T *)TPCircularBufferTail(&mBuffer, &availableBytes);
+        uint32_t count = tail ? availableBytes / (uint32_t)sizeof(T) : 0;
+        if (count > 0) {
+            uint64_t drained = now();
+            uint64_t latency = drained - std::min(drained, mPendingSince.load(std::memory_order_relaxed));
+            mLastLatency.store(latency, std::memory_order_relaxed);
+            if (latency > mMaxLatency.load(std::memory_order_relaxed)) {
+                mMaxLatency.store(latency, std::memory_order_relaxed);
+            }
+
+            process(tail, count);
+            TPCircularBufferConsume(&mBuffer, count * (uint32_t)sizeof(T));
+
+            // commands pushed while this drain ran have waited at most since it started
+            mPendingSince.store(drained, std::memory_order_relaxed);
+            if (mSpaceWanted.load() && mSpaceWanted.exchange(false) && mSpaceAvailable) {
+                mSpaceAvailable(mSpaceAvailableContext);
+            }
+        }
+        return count;
+    }
+
+private:
+    static uint64_t now() {
+        return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    TPCircularBuffer mBuffer;
+    void (*mSpaceAvailable)(void *context) = nullptr;
+    void *mSpaceAvailableContext = nullptr;
+    std::atomic<bool> mSpaceWanted { false };
+    // producer side
+    std::atomic<uint64_t> mPushed { 0 };
+    std::atomic<uint64_t> mDropped { 0 };
+    std::atomic<uint32_t> mHighWater { 0 };
+    // nanoseconds on the steady clock, written by both sides
+    std::atomic<uint64_t> mPendingSince { 0 };
+    // consumer side, nanoseconds
+    std::atomic<uint64_t> mLastLatency { 0 };
+    std::atomic<uint64_t> mMaxLatency { 0 };
+};
+
+#endif
@@ -0,0 +1,169 @@
+//
+//  EventSlotMap.hpp
+//  AUv3SequencerExample
+//
+//  Created by rumori on 2026. 10. 17..
+//
+
+#pragma once
+
+#ifdef __cplusplus
+
+#import <stdint.h>
+#import <vector>
+
+// An event as the slot map stores it
+struct SlotEvent {
+    MIDIEvent event;
+    // chord tones and length as in MIDIChordEvent (root and velocity in data1 and data2), 0 intervals for a single event
+    uint32_t intervals;
+    double duration;
+    uint32_t track;
+    // increases with every add, see EventSlotMap::forEach
+    uint64_t order;
+};
+
+// Owns the editable events of all tracks of a sequence and hands out stable handles for them.
+// A handle is the slot index in the low 32 bits and the slot generation in the high 32 bits,
+// so a handle to a deleted event never matches whatever reuses its slot.
+// Adding and deleting are O(1) and never move other events.
+// Every event can carry a `key` of the owner's choosing, clear hands it back for each event it removes.
+class EventSlotMap {
+public:
+    MIDIEventHandle add(const MIDIEvent &event, uint32_t track, uint64_t key = 0) {
+        return insert(event, 0, 0.0, track, key);
+    }
+
+    // a chord takes a single slot, however many notes it has
+    MIDIEventHandle addChord(const MIDIChordEvent &chord, uint32_t track, uint64_t key = 0) {
+        return insert({ chord.timestamp, 0x90, chord.root, chord.velocity }, chord.intervals, chord.duration, track, key);
+    }
+
+    // returns false for stale or unknown handles, `track` receives the track the event was on
+    bool remove(MIDIEventHandle handle, uint32_t *track = nullptr) {
+        Slot *slot = slotFor(handle);
+        if (!slot) return false;
+        if (track) *track = slot->track;
+        slot->occupied = false;
+        // skip 0 so no live handle is ever equal to MIDIEventHandleInvalid
+        if (++slot->generation == 0) slot->generation = 1;
+        slot->nextFree = mFreeHead;
+        mFreeHead = handleIndex(handle);
+        mCount--;
+        return true;
+    }
+
+    const MIDIEvent *find(MIDIEventHandle handle) const {
+        const Slot *slot = const_cast<EventSlotMap *>(this)->slotFor(handle);
+        return slot ? &slot->event : nullptr;
+    }
+
+    // everything stored for a live event, false for stale or unknown handles
+    bool get(MIDIEventHandle handle, SlotEvent &entry) const {
+        const Slot *slot = const_cast<EventSlotMap *>(this)->slotFor(handle);
+        if (!slot) return false;
+        entry = { slot->event, slot->intervals, slot->duration, slot->track, slot->order };
+        return true;
+    }
+
+    // removes the events of one track, calling `removed(key)` for each
+    template <typename Removed>
+    void clear(uint32_t track, Removed &&removed) {
+        for (size_t i = 0; i < mSlots.size(); i++) {
+            if (mSlots[i].occupied && mSlots[i].track == track) {
+                removed(mSlots[i].key);
+                remove(makeHandle((uint32_t)i, mSlots[i].generation));
+            }
+        }
+    }
+
+    void clear(uint32_t track) {
+        clear(track, [](uint64_t) {});
+    }
+
+    size_t size() const {
+        return mCount;
+    }
+
+    // Calls `callback(event, track, order)` for every live event other than chords, in slot order.
+    // `order` increases with every add, so ties can be broken by insertion order.
+    template <typename Callback>
+    void forEach(Callback &&callback) const {
+        for (const Slot &slot : mSlots) {
+            if (slot.occupied && slot.intervals == 0) {
+                callback(slot.event, slot.track, slot.order);
+            }
+        }
+    }
+
+    // Calls `callback(chord, track, order)` for every live chord, in slot order.
+    template <typename Callback>
+    void forEachChord(Callback &&callback) const {
+        for (const Slot &slot : mSlots) {
+            if (slot.occupied && slot.intervals != 0) {
+                MIDIChordEvent chord = { slot.event.timestamp, slot.duration, slot.event.data1, slot.event.data2, slot.intervals };
+                callback(chord, slot.track, slot.order);
+            }
+        }
+    }
+
+private:
+    static constexpr uint32_t NO_SLOT = UINT32_MAX;
+
+    struct Slot {
+        MIDIEvent event;
+        // chord tones, 0 for a plain event
+        uint32_t intervals = 0;
+        double duration = 0.0;
+        uint64_t order = 0;
+        uint64_t key = 0;
+        uint32_t track = 0;
+        uint32_t generation = 1;
+        uint32_t nextFree = NO_SLOT;
+        bool occupied = false;
+    };
+
+    MIDIEventHandle insert(const MIDIEvent &event, uint32_t intervals, double duration, uint32_t track, uint64_t key) {
+        uint32_t index;
+        if (mFreeHead != NO_SLOT) {
+            index = mFreeHead;
+            mFreeHead = mSlots[index].nextFree;
+        } else {
+            index = (uint32_t)mSlots.size();
+            mSlots.push_back({});
+        }
+        Slot &slot = mSlots[index];
+        slot.event = event;
+        slot.intervals = intervals;
+        slot.duration = duration;
+        slot.track = track;
+        slot.order = mNextOrder++;
+        slot.key = key;
+        slot.occupied = true;
+        mCount++;
+        return makeHandle(index, slot.generation);
+    }
+
+    static MIDIEventHandle makeHandle(uint32_t index, uint32_t generation) {
+        return ((uint64_t)generation << 32) | index;
+    }
+
+    static uint32_t handleIndex(MIDIEventHandle handle) {
+        return (uint32_t)(handle & 0xFFFFFFFF);
+    }
+
+    Slot *slotFor(MIDIEventHandle handle) {
+        uint32_t index = handleIndex(handle);
+        if (index >= mSlots.size()) return nullptr;
+        Slot &slot = mSlots[index];
+        if (!slot.occupied || slot.generation != (uint32_t)(handle >> 32)) return nullptr;
+        return &slot;
+    }
+
+    std::vector<Slot> mSlots;
+    uint32_t mFreeHead = NO_SLOT;
+    size_t mCount = 0;
+    uint64_t mNextOrder = 0;
+};
+
+#endif
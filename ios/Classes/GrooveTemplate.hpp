@@ -0,0 +1,97 @@
+//
+//  GrooveTemplate.hpp
+//  AUv3SequencerExample
+//
+//  Created by rumori on 2026. 10. 17..
+//
+
+#pragma once
+
+#ifdef __cplusplus
+
+#import <algorithm>
+#import <math.h>
+#import <stdint.h>
+#import <vector>
+
+// One step of a groove: how far its start moves, and how much louder or softer its notes get
+struct GrooveStep {
+    // in ticks, positive is late
+    double timing;
+    int8_t velocity;
+};
+
+// A timing and velocity feel applied while scheduling, so the stored events never change.
+// Timing works as a warp of each loop: every step start moves by its step's offset and the positions
+// in between stretch along with it. The warp only ever moves forwards, so events keep their order and
+// the scheduler can keep walking the stored events with a cursor. The first step of a loop stays in place.
+class GrooveTemplate {
+public:
+    // bumped on every publish, see MIDISequence::revision
+    uint64_t revision = 0;
+
+    // `steps` repeat every `stepTicks` ticks, offsets are clamped to less than half a step so the warp stays monotonic
+    void assign(int64_t stepTicks, const std::vector<GrooveStep> &steps) {
+        mStepTicks = stepTicks;
+        mSteps = steps;
+        double limit = stepTicks / 2.0 - 1.0;
+        for (GrooveStep &step : mSteps) {
+            step.timing = std::min(std::max(step.timing, -limit), limit);
+        }
+    }
+
+    bool isEmpty() const {
+        return mStepTicks <= 0 || mSteps.empty();
+    }
+
+    // the played position of the stored loop position `tick`
+    double warp(double tick, int64_t lengthInTicks) const {
+        if (isEmpty()) return tick;
+        int64_t step = std::max((int64_t)0, (int64_t)floor(tick / mStepTicks));
+        double start = (double)(step * mStepTicks);
+        double end = std::min(start + mStepTicks, (double)lengthInTicks);
+        if (end <= start) return tick;
+        double warpedStart = knot(step, lengthInTicks);
+        double warpedEnd = knot(step + 1, lengthInTicks);
+        return warpedStart + (tick - start) * (warpedEnd - warpedStart) / (end - start);
+    }
+
+    // the stored loop position that plays at `tick`, the inverse of warp
+    double unwarp(double tick, int64_t lengthInTicks) const {
+        if (isEmpty()) return tick;
+        int64_t lastStep = (lengthInTicks - 1) / mStepTicks;
+        int64_t step = std::min(std::max((int64_t)0, (int64_t)floor(tick / mStepTicks)), lastStep);
+        // a knot moves less than half a step, so the right step is at most one away
+        while (step > 0 && knot(step, lengthInTicks) > tick) step--;
+        while (step < lastStep && knot(step + 1, lengthInTicks) <= tick) step++;
+        double start = (double)(step * mStepTicks);
+        double end = std::min(start + mStepTicks, (double)lengthInTicks);
+        double warpedStart = knot(step, lengthInTicks);
+        double warpedEnd = knot(step + 1, lengthInTicks);
+        if (warpedEnd <= warpedStart) return start;
+        return start + (tick - warpedStart) * (end - start) / (warpedEnd - warpedStart);
+    }
+
+    // the velocity of a note on at the stored loop position `tick`
+    uint8_t velocity(int64_t tick, uint8_t velocity) const {
+        if (isEmpty() || velocity == 0) return velocity;
+        const GrooveStep &step = mSteps[(size_t)((tick / mStepTicks) % (int64_t)mSteps.size())];
+        return (uint8_t)std::min(std::max((int)velocity + step.velocity, 1), 127);
+    }
+
+private:
+    // where step start `step` plays, the loop's start and end stay in place
+    double knot(int64_t step, int64_t lengthInTicks) const {
+        double position = (double)(step * mStepTicks);
+        if (step == 0 || position >= lengthInTicks) return std::min(position, (double)lengthInTicks);
+        double timing = mSteps[(size_t)(step % (int64_t)mSteps.size())].timing;
+        // a loop that ends mid-step leaves a shorter last step to move into
+        double limit = (std::min(position + mStepTicks, (double)lengthInTicks) - position) / 2.0;
+        return position + std::min(timing, limit);
+    }
+
+    int64_t mStepTicks = 0;
+    std::vector<GrooveStep> mSteps;
+};
+
+#endif
@@ -23,8 +23,15 @@ public:
         mHeldNotes[note] = 0;
     }
     
-    void pressNote(uint8_t note) {
+    // `velocity` at MIDI 2.0 resolution
+    void pressNote(uint8_t note, uint16_t velocity = UINT16_MAX) {
         mHeldNotes[note] = 1;
+        mVelocities[note] = velocity;
+    }
+    
+    // the velocity the note was pressed with
+    uint16_t noteVelocity(uint8_t note) const {
+        return mVelocities[note];
     }
     
     int16_t firstPressedNote() {
@@ -37,7 +44,8 @@ public:
     }
     
 private:
-    uint8_t mHeldNotes[NOTES_COUNT];
+    uint8_t mHeldNotes[NOTES_COUNT] = {};
+    uint16_t mVelocities[NOTES_COUNT] = {};
 };
 
 #endif
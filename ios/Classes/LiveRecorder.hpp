@@ -0,0 +1,93 @@
+//
+//  LiveRecorder.hpp
+//  AUv3SequencerExample
+//
+//  Created by rumori on 2026. 10. 17..
+//
+
+#pragma once
+
+#ifdef __cplusplus
+
+#import <atomic>
+#import <chrono>
+#import <functional>
+#import <stdint.h>
+#import <thread>
+#import <pthread.h>
+#import "CommandQueue.hpp"
+
+// A note event played into the sequencer, placed on the kernel's tick timeline
+struct RecordedEvent {
+    // position on the timeline when the event arrived, not yet reduced to a loop
+    double tick;
+    int64_t sampleTime;
+    uint8_t status;
+    uint8_t data1;
+    uint8_t data2;
+};
+
+// Carries recorded events from the render thread to a background thread that merges them into the pattern.
+// The render thread only copies fixed-size records into a command queue, and drops them (counted) when it is full.
+class LiveRecorder {
+public:
+    // `merge(events, count)` runs on the recorder's own thread
+    explicit LiveRecorder(std::function<void(const RecordedEvent *, uint32_t)> merge, uint32_t capacity = 16384)
+    : mMerge(std::move(merge)), mEvents(capacity / sizeof(RecordedEvent)) {
+        mRunning = true;
+        mMergeThread = std::thread([this] { run(); });
+    }
+
+    ~LiveRecorder() {
+        mRunning = false;
+        mMergeThread.join();
+    }
+
+    LiveRecorder(const LiveRecorder &) = delete;
+    LiveRecorder &operator=(const LiveRecorder &) = delete;
+
+    void setEnabled(bool enabled) {
+        mEnabled.store(enabled, std::memory_order_release);
+    }
+
+    bool isEnabled() const {
+        return mEnabled.load(std::memory_order_acquire);
+    }
+
+    // render thread, returns false when the event did not fit
+    bool record(const RecordedEvent &event) {
+        return mEvents.push(event);
+    }
+
+    uint64_t droppedCount() const {
+        return mEvents.stats().dropped;
+    }
+
+    // any thread
+    QueueStats stats() const {
+        return mEvents.stats();
+    }
+
+private:
+    void run() {
+#ifdef __APPLE__
+        pthread_set_qos_class_self_np(QOS_CLASS_UTILITY, 0);
+#endif
+        while (mRunning.load(std::memory_order_acquire)) {
+            drain();
+            std::this_thread::sleep_for(std::chrono::milliseconds(20));
+        }
+    }
+
+    void drain() {
+        mEvents.drain(mMerge);
+    }
+
+    std::function<void(const RecordedEvent *, uint32_t)> mMerge;
+    CommandQueue<RecordedEvent> mEvents;
+    std::atomic<bool> mEnabled { false };
+    std::atomic<bool> mRunning { false };
+    std::thread mMergeThread;
+};
+
+#endif
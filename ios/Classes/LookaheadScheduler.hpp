@@ -0,0 +1,299 @@
+//
+//  LookaheadScheduler.hpp
+//  AUv3SequencerExample
+//
+//  Created by rumori on 2026. 10. 17..
+//
+
+#pragma once
+
+#ifdef __cplusplus
+
+#import <algorithm>
+#import <atomic>
+#import <chrono>
+#import <stdint.h>
+#import <string.h>
+#import <thread>
+#import <type_traits>
+#import <vector>
+#import <pthread.h>
+#import "RenderEpoch.hpp"
+#import "SequenceScheduler.hpp"
+
+// Runs the internal clock and the sequence scan on a low-priority worker, a configurable window ahead
+// of the playhead, and bins the results into a ring of fixed-size blocks with their frame offsets resolved.
+// The render thread then only copies out the blocks its buffer covers, whatever the pattern looks like.
+//
+// Blocks are numbered from the frame at which the render thread handed its clock over. Each block carries
+// the clock state at its end, so the render thread can take over again at any block boundary, and schedules
+// any stretch the worker did not reach in time directly.
+//
+// The hand-over and the blocks are both read seqlock-style while their writer may be storing them, so
+// they are kept in relaxed atomics: a torn copy is caught by the sequence check, and is never a data race.
+class LookaheadScheduler {
+public:
+    static constexpr uint32_t BLOCK_FRAMES = 64;
+    static constexpr uint32_t MAX_BLOCKS = 1024;
+    static constexpr uint32_t MAX_EVENTS_PER_BLOCK = 128;
+    static constexpr double MIN_SLEEP_SECONDS = 0.0005;
+    static constexpr double MAX_SLEEP_SECONDS = 0.02;
+
+    LookaheadScheduler(const EpochPointer<PatternBank> &bank, const EpochPointer<TempoMap> &tempoMap,
+                       const EpochPointer<GrooveTemplate> &groove, RenderEpoch &epoch)
+    : mBank(bank), mTempoMap(tempoMap), mGroove(groove), mEpoch(epoch), mBuckets(MAX_BLOCKS) {
+        mRunning = true;
+        mWorker = std::thread([this] { run(); });
+    }
+
+    ~LookaheadScheduler() {
+        mRunning = false;
+        mWorker.join();
+    }
+
+    // any thread, clamped so the worker can never lap a block the render thread has not played
+    void setWindow(uint32_t frames) {
+        mWindowFrames.store(std::min(std::max(frames, BLOCK_FRAMES), (MAX_BLOCKS - 1) * BLOCK_FRAMES), std::memory_order_relaxed);
+    }
+
+    // number of blocks the render thread had to schedule itself because the worker was late
+    uint64_t underrunCount() const {
+        return mUnderruns.load(std::memory_order_relaxed);
+    }
+
+    // number of events lost because a block held more than MAX_EVENTS_PER_BLOCK
+    uint64_t droppedEventCount() const {
+        return mDroppedEvents.load(std::memory_order_relaxed);
+    }
+
+    // render thread, hands the clock to the worker from `frame` onwards, `looping` as in SequenceScheduler::schedule
+    void handOver(uint64_t frame, const InternalClock &clock, double sampleRate, bool looping = true) {
+        mGeneration++;
+        mHandoffFrame = frame;
+        // odd while the hand-over is being written
+        uint64_t sequence = mHandoffSequence.load(std::memory_order_relaxed);
+        mHandoffSequence.store(sequence + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        mHandoff.store({ mGeneration, frame, clock, sampleRate, looping });
+        mHandoffSequence.store(sequence + 2, std::memory_order_release);
+        mPublishedGeneration.store(mGeneration, std::memory_order_release);
+        mRenderFrame.store(frame, std::memory_order_release);
+    }
+
+    // Render thread. Calls `emit(event, offset)` for the binned events in [frame, frame + frameCount)
+    // and `fallback(frame, frameCount)` for every stretch whose block was not ready.
+    // `clock` is kept in step with the worker at every block boundary.
+    template <typename Emit, typename Fallback>
+    void render(uint64_t frame, uint32_t frameCount, InternalClock &clock, Emit &&emit, Fallback &&fallback) {
+        const uint64_t end = frame + frameCount;
+        uint64_t position = frame;
+        while (position < end) {
+            uint64_t block = (position - mHandoffFrame) / BLOCK_FRAMES;
+            uint64_t blockStart = mHandoffFrame + block * BLOCK_FRAMES;
+            uint64_t blockEnd = blockStart + BLOCK_FRAMES;
+            uint64_t sliceEnd = std::min(end, blockEnd);
+            Bucket &bucket = mBuckets[block % MAX_BLOCKS];
+            if (readBucket(bucket, stampFor(mGeneration, block))) {
+                // an event rounded onto the very end of its block still belongs to the block's last slice
+                bool lastSlice = sliceEnd == blockEnd;
+                for (uint32_t i = 0; i < mScratchCount; i++) {
+                    const ScheduledEvent &event = mScratch[i];
+                    uint64_t eventFrame = blockStart + event.offset;
+                    if (eventFrame >= position && (eventFrame < sliceEnd || lastSlice)) {
+                        emit(TickEvent { 0, event.status, event.data1, event.data2, event.cable }, (double)(eventFrame - frame));
+                    }
+                }
+                if (sliceEnd == blockEnd) {
+                    clock = mScratchClock;
+                }
+            } else {
+                mUnderruns.fetch_add(1, std::memory_order_relaxed);
+                fallback(position, (uint32_t)(sliceEnd - position));
+            }
+            position = sliceEnd;
+        }
+        mRenderFrame.store(end, std::memory_order_release);
+    }
+
+private:
+    struct ScheduledEvent {
+        uint16_t offset;
+        uint8_t status;
+        uint8_t data1;
+        uint8_t data2;
+        uint8_t cable;
+    };
+
+    // a trivially copyable value as relaxed atomic words, for copying under a sequence check
+    template <typename T>
+    class AtomicWords {
+    public:
+        static_assert(std::is_trivially_copyable<T>::value, "stored as bytes");
+
+        void store(const T &value) {
+            uint64_t words[WORDS] = {};
+            memcpy(words, &value, sizeof(T));
+            for (size_t i = 0; i < WORDS; i++) {
+                mWords[i].store(words[i], std::memory_order_relaxed);
+            }
+        }
+
+        T load() const {
+            uint64_t words[WORDS];
+            for (size_t i = 0; i < WORDS; i++) {
+                words[i] = mWords[i].load(std::memory_order_relaxed);
+            }
+            T value;
+            memcpy(&value, words, sizeof(T));
+            return value;
+        }
+
+    private:
+        static constexpr size_t WORDS = (sizeof(T) + sizeof(uint64_t) - 1) / sizeof(uint64_t);
+        std::atomic<uint64_t> mWords[WORDS] = {};
+    };
+
+    struct Bucket {
+        // generation and block number, 0 while the worker writes the bucket
+        std::atomic<uint64_t> stamp { 0 };
+        std::atomic<uint32_t> count { 0 };
+        // ScheduledEvents packed into a word each
+        std::atomic<uint64_t> events[MAX_EVENTS_PER_BLOCK] = {};
+        AtomicWords<InternalClock> clockAfter;
+    };
+
+    struct Handoff {
+        uint64_t generation;
+        uint64_t frame;
+        InternalClock clock;
+        double sampleRate;
+        bool looping;
+    };
+
+    static uint64_t pack(const ScheduledEvent &event) {
+        return (uint64_t)event.offset | ((uint64_t)event.status << 16) | ((uint64_t)event.data1 << 24)
+            | ((uint64_t)event.data2 << 32) | ((uint64_t)event.cable << 40);
+    }
+
+    static ScheduledEvent unpack(uint64_t word) {
+        return { (uint16_t)word, (uint8_t)(word >> 16), (uint8_t)(word >> 24), (uint8_t)(word >> 32), (uint8_t)(word >> 40) };
+    }
+
+    static uint64_t stampFor(uint64_t generation, uint64_t block) {
+        return (generation << 48) | ((block + 1) & 0xFFFFFFFFFFFF);
+    }
+
+    // copies a bucket out seqlock-style, so a worker lagging behind a hand-over can never tear it
+    bool readBucket(const Bucket &bucket, uint64_t expectedStamp) {
+        if (bucket.stamp.load(std::memory_order_acquire) != expectedStamp) return false;
+        mScratchCount = std::min(bucket.count.load(std::memory_order_relaxed), MAX_EVENTS_PER_BLOCK);
+        for (uint32_t i = 0; i < mScratchCount; i++) {
+            mScratch[i] = unpack(bucket.events[i].load(std::memory_order_relaxed));
+        }
+        mScratchClock = bucket.clockAfter.load();
+        std::atomic_thread_fence(std::memory_order_acquire);
+        return bucket.stamp.load(std::memory_order_relaxed) == expectedStamp;
+    }
+
+    // worker, false when the render thread is writing a hand-over right now
+    bool readHandoff(Handoff &handoff) const {
+        uint64_t before = mHandoffSequence.load(std::memory_order_acquire);
+        if (before & 1) return false;
+        handoff = mHandoff.load();
+        std::atomic_thread_fence(std::memory_order_acquire);
+        return mHandoffSequence.load(std::memory_order_relaxed) == before;
+    }
+
+    void run() {
+#ifdef __APPLE__
+        pthread_set_qos_class_self_np(QOS_CLASS_UTILITY, 0);
+#endif
+        uint64_t generation = 0;
+        Handoff handoff = {};
+        uint64_t nextBlock = 0;
+        SequenceScheduler scheduler;
+
+        while (mRunning.load(std::memory_order_acquire)) {
+            uint64_t published = mPublishedGeneration.load(std::memory_order_acquire);
+            if (published != generation) {
+                // the latest hand-over, which may already be newer than `published`
+                if (!readHandoff(handoff)) continue;
+                generation = handoff.generation;
+                nextBlock = 0;
+                scheduler = SequenceScheduler();
+            }
+
+            uint32_t windowFrames = mWindowFrames.load(std::memory_order_relaxed);
+            if (generation != 0) {
+                uint64_t renderFrame = std::max(mRenderFrame.load(std::memory_order_acquire), handoff.frame);
+                while (handoff.frame + nextBlock * BLOCK_FRAMES < renderFrame + windowFrames
+                       && mPublishedGeneration.load(std::memory_order_relaxed) == generation) {
+                    fillBucket(mBuckets[nextBlock % MAX_BLOCKS], stampFor(generation, nextBlock),
+                               handoff.frame + nextBlock * BLOCK_FRAMES, handoff, scheduler);
+                    nextBlock++;
+                }
+            }
+
+            // wake up a few times per window, well before the render thread catches up,
+            // and often enough to notice a hand-over or shutdown quickly
+            double sleepSeconds = generation != 0 ? windowFrames / handoff.sampleRate / 4.0 : MAX_SLEEP_SECONDS;
+            sleepSeconds = std::min(std::max(sleepSeconds, MIN_SLEEP_SECONDS), MAX_SLEEP_SECONDS);
+            std::this_thread::sleep_for(std::chrono::microseconds((int64_t)(sleepSeconds * 1e6)));
+        }
+    }
+
+    void fillBucket(Bucket &bucket, uint64_t stamp, uint64_t blockStart, Handoff &handoff, SequenceScheduler &scheduler) {
+        RenderEpoch::Scope epochScope(mEpoch);
+        const PatternBank &bank = *mBank.load();
+        const TempoMap &tempoMap = *mTempoMap.load();
+        const GrooveTemplate &groove = *mGroove.load();
+
+        bucket.stamp.store(0, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+
+        uint32_t count = 0;
+        ClockWindow window = handoff.clock.advance(tempoMap, blockStart, BLOCK_FRAMES, handoff.sampleRate);
+        auto bin = [&](const TickEvent &event, double offset) {
+            if (count == MAX_EVENTS_PER_BLOCK) {
+                mDroppedEvents.fetch_add(1, std::memory_order_relaxed);
+                return;
+            }
+            bucket.events[count++].store(pack({ (uint16_t)offset, event.status, event.data1, event.data2, event.cable }), std::memory_order_relaxed);
+        };
+        if (handoff.looping) {
+            scheduler.schedule<true>(bank, groove, window, handoff.clock.pattern, bin);
+        } else {
+            scheduler.schedule<false>(bank, groove, window, handoff.clock.pattern, bin);
+        }
+        bucket.count.store(count, std::memory_order_relaxed);
+        bucket.clockAfter.store(handoff.clock);
+
+        bucket.stamp.store(stamp, std::memory_order_release);
+    }
+
+    const EpochPointer<PatternBank> &mBank;
+    const EpochPointer<TempoMap> &mTempoMap;
+    const EpochPointer<GrooveTemplate> &mGroove;
+    RenderEpoch &mEpoch;
+
+    std::vector<Bucket> mBuckets;
+    std::atomic<uint32_t> mWindowFrames { 4096 };
+    std::atomic<uint64_t> mRenderFrame { 0 };
+    std::atomic<uint64_t> mPublishedGeneration { 0 };
+    std::atomic<uint64_t> mUnderruns { 0 };
+    std::atomic<uint64_t> mDroppedEvents { 0 };
+    std::atomic<bool> mRunning { false };
+    std::thread mWorker;
+
+    // written by the render thread before publishing a generation, odd sequence while it writes
+    std::atomic<uint64_t> mHandoffSequence { 0 };
+    AtomicWords<Handoff> mHandoff;
+    // render thread state
+    uint64_t mGeneration = 0;
+    uint64_t mHandoffFrame = 0;
+    ScheduledEvent mScratch[MAX_EVENTS_PER_BLOCK];
+    uint32_t mScratchCount = 0;
+    InternalClock mScratchClock;
+};
+
+#endif
@@ -0,0 +1,181 @@
+//
+//  MIDIOutputBatch.hpp
+//  AUv3SequencerExample
+//
+//  Created by rumori on 2026. 10. 17..
+//
+
+#pragma once
+
+#import <AudioToolbox/AudioToolbox.h>
+#import <CoreMIDI/CoreMIDI.h>
+
+#ifdef __cplusplus
+
+#import <algorithm>
+#import <atomic>
+#import <stdint.h>
+
+// Collects the MIDI output of one render cycle in preallocated storage and hands it to the host
+// in sample order at the end of the cycle. Events sharing a sample time and cable go out as a single
+// MIDI event list when the host takes lists, otherwise everything goes out in one tight loop.
+// The scheduler adds events track by track, so the batch is a handful of sorted runs; they are
+// appended as they come and merged once at the flush.
+class MIDIOutputBatch {
+public:
+    static constexpr uint32_t CAPACITY = 1024;
+
+    // render thread, events past CAPACITY in one cycle are dropped and counted
+    void add(AUEventSampleTime sampleTime, uint8_t cable, uint8_t status, uint8_t data1, uint8_t data2) {
+        if (mCount == CAPACITY) {
+            mDropped.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+        if (mCount > 0 && sampleTime < mEvents[mCount - 1].sampleTime) {
+            mSorted = false;
+        }
+        mEvents[mCount++] = { sampleTime, cable, status, data1, data2 };
+    }
+
+    void setOutputBlocks(AUMIDIOutputEventBlock eventBlock, AUMIDIEventListBlock eventListBlock) {
+        mEventBlock = eventBlock;
+        mEventListBlock = eventListBlock;
+    }
+
+    // render thread, at the end of the cycle
+    void flush() {
+        if (mCount == 0) return;
+        if (!mSorted) {
+            sort();
+            mSorted = true;
+        }
+        mSent.fetch_add(mCount, std::memory_order_relaxed);
+        mLastCount.store(mCount, std::memory_order_relaxed);
+        if (mCount > mHighWater.load(std::memory_order_relaxed)) {
+            mHighWater.store(mCount, std::memory_order_relaxed);
+        }
+        if (mEventListBlock) {
+            if (__builtin_available(iOS 15.0, macOS 12.0, *)) {
+                flushEventLists();
+            }
+        } else if (mEventBlock) {
+            for (uint32_t i = 0; i < mCount; i++) {
+                const Event &event = mEvents[i];
+                uint8_t midiData[] = { event.status, event.data1, event.data2 };
+                mEventBlock(event.sampleTime, event.cable, messageLength(event.status), midiData);
+            }
+        }
+        mCount = 0;
+    }
+
+    // any thread, events handed to the host so far
+    uint64_t sentCount() const {
+        return mSent.load(std::memory_order_relaxed);
+    }
+
+    // any thread, events lost to a full batch or to an event list that could not take them
+    uint64_t droppedCount() const {
+        return mDropped.load(std::memory_order_relaxed);
+    }
+
+    // any thread, the events of the last cycle and the most a cycle ever had
+    uint32_t lastCount() const {
+        return mLastCount.load(std::memory_order_relaxed);
+    }
+
+    uint32_t highWater() const {
+        return mHighWater.load(std::memory_order_relaxed);
+    }
+
+private:
+    struct Event {
+        AUEventSampleTime sampleTime;
+        uint8_t cable;
+        uint8_t status;
+        uint8_t data1;
+        uint8_t data2;
+    };
+
+    // program change and channel pressure carry a single data byte
+    static uint8_t messageLength(uint8_t status) {
+        uint8_t opcode = status & 0xF0;
+        return (opcode == 0xC0 || opcode == 0xD0) ? 2 : 3;
+    }
+
+    // Merges neighbouring sorted runs until one is left, between mEvents and mScratch. std::merge is stable,
+    // so events on the same sample time keep the order they were added in. O(n log runs), no allocation.
+    void sort() {
+        auto earlier = [](const Event &a, const Event &b) { return a.sampleTime < b.sampleTime; };
+        Event *source = mEvents;
+        Event *target = mScratch;
+        while (true) {
+            uint32_t runs = 0;
+            uint32_t start = 0;
+            while (start < mCount) {
+                uint32_t middle = runEnd(source, start);
+                uint32_t end = runEnd(source, middle);
+                std::merge(source + start, source + middle, source + middle, source + end, target + start, earlier);
+                start = end;
+                runs++;
+            }
+            std::swap(source, target);
+            if (runs <= 1) break;
+        }
+        if (source != mEvents) {
+            std::copy(source, source + mCount, mEvents);
+        }
+    }
+
+    // the end of the sorted run starting at `start`
+    uint32_t runEnd(const Event *events, uint32_t start) const {
+        if (start >= mCount) return mCount;
+        uint32_t end = start + 1;
+        while (end < mCount && events[end].sampleTime >= events[end - 1].sampleTime) end++;
+        return end;
+    }
+
+    API_AVAILABLE(ios(15.0), macos(12.0))
+    void flushEventLists() {
+        MIDIEventList *list = (MIDIEventList *)mListStorage;
+        uint32_t start = 0;
+        while (start < mCount) {
+            const Event &first = mEvents[start];
+            MIDIEventPacket *packet = MIDIEventListInit(list, kMIDIProtocol_1_0);
+            uint32_t end = start;
+            while (end < mCount && mEvents[end].sampleTime == first.sampleTime && mEvents[end].cable == first.cable) {
+                const Event &event = mEvents[end];
+                // a MIDI 1.0 channel voice message as a single Universal MIDI Packet word
+                UInt32 word = 0x20000000u | ((UInt32)event.status << 16) | ((UInt32)event.data1 << 8)
+                    | (messageLength(event.status) == 3 ? event.data2 : 0);
+                MIDIEventPacket *next = MIDIEventListAdd(list, sizeof(mListStorage), packet, 0, 1, &word);
+                // send what fits and start a new list for the rest
+                if (!next) break;
+                packet = next;
+                end++;
+            }
+            if (end == start) {
+                // not even a fresh list took the event
+                mDropped.fetch_add(1, std::memory_order_relaxed);
+                start++;
+                continue;
+            }
+            mEventListBlock(first.sampleTime, first.cable, list);
+            start = end;
+        }
+    }
+
+    Event mEvents[CAPACITY];
+    Event mScratch[CAPACITY];
+    uint32_t mCount = 0;
+    // false once an event was added before the one added last
+    bool mSorted = true;
+    std::atomic<uint64_t> mSent { 0 };
+    std::atomic<uint64_t> mDropped { 0 };
+    std::atomic<uint32_t> mLastCount { 0 };
+    std::atomic<uint32_t> mHighWater { 0 };
+    alignas(MIDIEventList) uint8_t mListStorage[4096];
+    AUMIDIOutputEventBlock mEventBlock = nullptr;
+    AUMIDIEventListBlock mEventListBlock = nullptr;
+};
+
+#endif
@@ -0,0 +1,275 @@
+//
+//  MIDISequence.hpp
+//  AUv3SequencerExample
+//
+//  Created by rumori on 2026. 10. 17..
+//
+
+#pragma once
+
+#ifdef __cplusplus
+
+#import <algorithm>
+#import <math.h>
+#import <stdint.h>
+#import <vector>
+#import "AutomationLane.hpp"
+#import "EventSlotMap.hpp"
+
+// pulses per quarter note, the resolution of the sequencer timeline
+static constexpr int64_t SEQUENCER_PPQN = 960;
+
+// the most tracks a sequence can hold, so the render thread can keep per-track state in fixed arrays
+static constexpr size_t SEQUENCER_MAX_TRACKS = 64;
+
+// A MIDI event placed on the integer tick timeline, with its track's channel and cable already applied
+struct TickEvent {
+    int64_t tick;
+    uint8_t status;
+    uint8_t data1;
+    uint8_t data2;
+    uint8_t cable;
+    // a chord's note on or off for every tone, see MIDIChordEvent, 0 for a single event
+    uint32_t intervals;
+};
+
+// One event added to or removed from a sequence since the last publish, see MIDISequence::applyEdit
+struct SequenceEdit {
+    SlotEvent slot;
+    bool insert;
+};
+
+// The control thread's settings for one track
+struct TrackSettings {
+    // loop length in beats
+    double length = 4.0;
+    uint8_t channel = 0;
+    uint8_t cable = 0;
+};
+
+// Several loops of MIDI events, one per track, each kept sorted by tick and looping at its own length.
+// The events of all tracks share one contiguous array and the tracks themselves are stored as parallel
+// arrays, so scanning many tracks per buffer stays cache friendly.
+// The render thread plays a published, immutable copy and keeps its own cursors into it,
+// so rendering a buffer only touches the events that actually fall inside it.
+class MIDISequence {
+public:
+    // bumped on every publish, so the render thread notices a new sequence even at a recycled address
+    uint64_t revision = 0;
+
+    MIDISequence() {
+        TrackSettings settings;
+        mLengthsInTicks.push_back(beatsToTicks(settings.length));
+        mTrackStarts.assign(2, 0);
+        mVelocityLanes.assign(1, -1);
+    }
+
+    static int64_t beatsToTicks(double beats) {
+        return llround(beats * SEQUENCER_PPQN);
+    }
+
+    size_t trackCount() const {
+        return mLengthsInTicks.size();
+    }
+
+    // the length of a track's loop in ticks (4 * SEQUENCER_PPQN == 4 quarter notes)
+    int64_t lengthInTicks(size_t track) const {
+        return mLengthsInTicks[track];
+    }
+
+    size_t eventCount() const {
+        return events.size();
+    }
+
+    const TickEvent &eventAt(size_t index) const {
+        return events[index];
+    }
+
+    size_t automationLaneCount() const {
+        return mLanes.size();
+    }
+
+    const AutomationLane &automationLane(size_t index) const {
+        return mLanes[index];
+    }
+
+    // the lane scaling the velocities of `track`, or nullptr
+    const AutomationLane *velocityLane(size_t track) const {
+        int32_t index = mVelocityLanes[track];
+        return index < 0 ? nullptr : &mLanes[index];
+    }
+
+    // Rebuilds the sorted event lists from the editable events, on the control thread.
+    // Events sharing a tick keep the order they were added in, events and lanes of tracks past `tracks` are left out.
+    // `tracks` must not be empty.
+    void assign(const EventSlotMap &slots, const std::vector<TrackSettings> &tracks, const std::vector<AutomationLane> &lanes = {}) {
+        size_t trackCount = std::min(tracks.size(), SEQUENCER_MAX_TRACKS);
+        mLengthsInTicks.clear();
+        for (size_t track = 0; track < trackCount; track++) {
+            mLengthsInTicks.push_back(beatsToTicks(tracks[track].length));
+        }
+
+        mLanes.clear();
+        mVelocityLanes.assign(trackCount, -1);
+        for (const AutomationLane &lane : lanes) {
+            if (lane.track >= trackCount || lane.points.empty() || mLanes.size() == SEQUENCER_MAX_AUTOMATION_LANES) continue;
+            if (lane.target == SEQUENCER_AUTOMATION_VELOCITY) mVelocityLanes[lane.track] = (int32_t)mLanes.size();
+            mLanes.push_back(lane);
+            mLanes.back().channel = tracks[lane.track].channel & 0x0F;
+            mLanes.back().cable = tracks[lane.track].cable;
+        }
+
+        // events on one tick go by rank: chord note offs first, the latest one ahead, then the rest in the order added
+        struct OrderedEvent {
+            TickEvent event;
+            uint32_t track;
+            int64_t rank;
+        };
+        std::vector<OrderedEvent> ordered;
+        ordered.reserve(slots.size());
+        slots.forEach([&](const MIDIEvent &event, uint32_t track, uint64_t order) {
+            if (track >= trackCount) return;
+            ordered.push_back({ tickEvent(event, tracks[track]), track, (int64_t)order });
+        });
+        slots.forEachChord([&](const MIDIChordEvent &chord, uint32_t track, uint64_t order) {
+            if (track >= trackCount) return;
+            TickEvent noteOn, noteOff;
+            chordEvents(chord, tracks[track], mLengthsInTicks[track], noteOn, noteOff);
+            ordered.push_back({ noteOn, track, (int64_t)order });
+            // ahead of everything else on its tick, so a chord ending where the next one starts never cuts it off
+            ordered.push_back({ noteOff, track, noteOffRank(order) });
+        });
+        std::sort(ordered.begin(), ordered.end(), [](const OrderedEvent &a, const OrderedEvent &b) {
+            if (a.track != b.track) return a.track < b.track;
+            if (a.event.tick != b.event.tick) return a.event.tick < b.event.tick;
+            return a.rank < b.rank;
+        });
+        events.clear();
+        events.reserve(ordered.size());
+        mRanks.clear();
+        mRanks.reserve(ordered.size());
+        mTrackStarts.assign(trackCount + 1, 0);
+        for (const OrderedEvent &entry : ordered) {
+            events.push_back(entry.event);
+            mRanks.push_back(entry.rank);
+            mTrackStarts[entry.track + 1]++;
+        }
+        for (size_t track = 0; track < trackCount; track++) {
+            mTrackStarts[track + 1] += mTrackStarts[track];
+        }
+    }
+
+    // Applies one edit to a copy of a published sequence, on the control thread. The event lands exactly where
+    // assign would have sorted it, so a single edit costs one pass over the events instead of collecting and
+    // sorting all of them again. `tracks` must be the settings the sequence was built with.
+    // Returns false when a removed event is not in the sequence, the caller then rebuilds it with assign.
+    bool applyEdit(const SequenceEdit &edit, const std::vector<TrackSettings> &tracks) {
+        const SlotEvent &slot = edit.slot;
+        // events of tracks past the count are left out, as in assign
+        if (slot.track >= trackCount()) return true;
+        const TrackSettings &settings = tracks[slot.track];
+        if (slot.intervals == 0) {
+            return patch(slot.track, tickEvent(slot.event, settings), (int64_t)slot.order, edit.insert);
+        }
+        MIDIChordEvent chord = { slot.event.timestamp, slot.duration, slot.event.data1, slot.event.data2, slot.intervals };
+        TickEvent noteOn, noteOff;
+        chordEvents(chord, settings, mLengthsInTicks[slot.track], noteOn, noteOff);
+        return patch(slot.track, noteOn, (int64_t)slot.order, edit.insert) && patch(slot.track, noteOff, noteOffRank(slot.order), edit.insert);
+    }
+
+    // The index of the first event of `track` at or after `tick`.
+    // Only needed after a jump in the playhead or a new sequence, otherwise the cursor just advances.
+    size_t seek(size_t track, int64_t tick) const {
+        auto first = events.begin() + mTrackStarts[track];
+        auto last = events.begin() + mTrackStarts[track + 1];
+        auto position = std::lower_bound(first, last, tick, [](const TickEvent &event, int64_t tick) {
+            return event.tick < tick;
+        });
+        return position - events.begin();
+    }
+
+    // the index of the first event of `track`, where its cursor restarts after a loop transition
+    size_t trackStart(size_t track) const {
+        return mTrackStarts[track];
+    }
+
+    // Calls `callback(event)` for every event of `track` from `cursor` up to (not including) `toTick`
+    // and returns the advanced cursor.
+    template <typename Callback>
+    size_t consumeUntil(size_t track, size_t cursor, double toTick, Callback &&callback) const {
+        const size_t end = mTrackStarts[track + 1];
+        while (cursor < end && events[cursor].tick < toTick) {
+            callback(events[cursor]);
+            cursor++;
+        }
+        return cursor;
+    }
+
+private:
+    // channel voice messages go out on the track's channel
+    static TickEvent tickEvent(const MIDIEvent &event, const TrackSettings &settings) {
+        uint8_t status = event.status;
+        if (status >= 0x80 && status < 0xF0) {
+            status = (status & 0xF0) | (settings.channel & 0x0F);
+        }
+        return { beatsToTicks(event.timestamp), status, event.data1, event.data2, settings.cable, 0 };
+    }
+
+    // a chord stays two events however many tones it has, its note off wraps into the loop
+    static void chordEvents(const MIDIChordEvent &chord, const TrackSettings &settings, int64_t lengthInTicks, TickEvent &noteOn, TickEvent &noteOff) {
+        int64_t start = beatsToTicks(chord.timestamp);
+        int64_t end = start + std::max(beatsToTicks(chord.duration), (int64_t)1);
+        if (lengthInTicks > 0 && end >= lengthInTicks) end %= lengthInTicks;
+        uint8_t channel = settings.channel & 0x0F;
+        noteOn = { start, (uint8_t)(0x90 | channel), chord.root, chord.velocity, settings.cable, chord.intervals };
+        noteOff = { end, (uint8_t)(0x80 | channel), chord.root, 0, settings.cable, chord.intervals };
+    }
+
+    // a chord's note off goes ahead of everything else on its tick, so a chord ending where the next one
+    // starts never cuts it off, the latest one first
+    static int64_t noteOffRank(uint64_t order) {
+        return -(int64_t)order - 1;
+    }
+
+    // inserts `event` with `rank` into `track`, or removes it
+    bool patch(uint32_t track, const TickEvent &event, int64_t rank, bool insert) {
+        size_t first = mTrackStarts[track];
+        size_t count = mTrackStarts[track + 1] - first;
+        // the first position not ordered before (tick, rank)
+        while (count > 0) {
+            size_t half = count / 2;
+            size_t middle = first + half;
+            if (events[middle].tick < event.tick || (events[middle].tick == event.tick && mRanks[middle] < rank)) {
+                first = middle + 1;
+                count -= half + 1;
+            } else {
+                count = half;
+            }
+        }
+        if (insert) {
+            events.insert(events.begin() + first, event);
+            mRanks.insert(mRanks.begin() + first, rank);
+        } else {
+            if (first == mTrackStarts[track + 1] || events[first].tick != event.tick || mRanks[first] != rank) return false;
+            events.erase(events.begin() + first);
+            mRanks.erase(mRanks.begin() + first);
+        }
+        for (size_t next = track + 1; next < mTrackStarts.size(); next++) {
+            if (insert) mTrackStarts[next]++; else mTrackStarts[next]--;
+        }
+        return true;
+    }
+
+    std::vector<TickEvent> events;
+    // the tie-break of each event on its tick, parallel to events and only read by applyEdit
+    std::vector<int64_t> mRanks;
+    // per track, in parallel
+    std::vector<int64_t> mLengthsInTicks;
+    // the events of track `i` are [mTrackStarts[i], mTrackStarts[i + 1])
+    std::vector<uint32_t> mTrackStarts;
+    std::vector<AutomationLane> mLanes;
+    // per track, an index into mLanes or -1
+    std::vector<int32_t> mVelocityLanes;
+};
+
+#endif
@@ -0,0 +1,198 @@
+//
+//  MultiProducerQueue.hpp
+//  AUv3SequencerExample
+//
+//  Created by rumori on 2026. 10. 17..
+//
+
+#pragma once
+
+#ifdef __cplusplus
+
+#import <algorithm>
+#import <atomic>
+#import <chrono>
+#import <memory>
+#import <stdint.h>
+#import <type_traits>
+#import "CommandQueue.hpp"
+
+// A bounded queue of fixed-size commands that any number of threads can push to and one thread at a time drains.
+// Every cell carries a sequence number: a producer claims the next position with a compare and swap,
+// writes its command and then publishes the cell by advancing its sequence. Producers never wait for
+// each other, one that is interrupted mid-write only holds back the cells behind its own until it
+// finishes, and the consumer simply stops at the first cell that is not published yet.
+// Commands from one thread come out in the order it pushed them.
+// The consumer may change threads as long as the hand-over synchronizes (e.g. through a flag taken with acquire).
+// The statistics mostly fall out of the two positions; a push only does more work when it sets a new high-water mark.
+template <typename T>
+class MultiProducerQueue {
+public:
+    static_assert(std::is_trivially_copyable<T>::value, "commands are copied as bytes");
+
+    // room for at least `capacity` commands, rounded up to a power of two
+    explicit MultiProducerQueue(uint32_t capacity) {
+        uint32_t size = 2;
+        while (size < capacity) size <<= 1;
+        mMask = size - 1;
+        mCells.reset(new Cell[size]);
+        for (uint32_t i = 0; i < size; i++) {
+            mCells[i].sequence.store(i, std::memory_order_relaxed);
+        }
+    }
+
+    MultiProducerQueue(const MultiProducerQueue &) = delete;
+    MultiProducerQueue &operator=(const MultiProducerQueue &) = delete;
+
+    // any thread, returns false and counts the command as dropped when the queue is full
+    bool push(const T &command) {
+        if (tryPush(command)) return true;
+        markDropped();
+        return false;
+    }
+
+    // Any thread, never blocks. Like push, but a producer that gets false still owns the command and
+    // means to retry, so nothing is counted as dropped; instead the space available callback fires
+    // after the next drain that frees room.
+    bool tryPush(const T &command) {
+        if (enqueue(command)) return true;
+        mSpaceWanted.store(true);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        // a drain that finished before the flag was up will not call back, so look once more
+        return enqueue(command);
+    }
+
+    // any thread, counts commands a producer gave up on without pushing
+    void markDropped(uint32_t count = 1) {
+        mDropped.fetch_add(count, std::memory_order_relaxed);
+    }
+
+    // Called on the consumer's thread after a drain frees room that a failed tryPush was waiting for.
+    // Set before any producer starts.
+    void setSpaceAvailableCallback(void (*callback)(void *context), void *context) {
+        mSpaceAvailable = callback;
+        mSpaceAvailableContext = context;
+    }
+
+    // any thread
+    QueueStats stats() const {
+        uint64_t dequeued = mDequeuePosition.load(std::memory_order_relaxed);
+        uint64_t enqueued = std::max(mEnqueuePosition.load(std::memory_order_relaxed), dequeued);
+        QueueStats stats;
+        stats.capacity = (uint32_t)(mMask + 1);
+        // the positions are read one after the other, a push in between must not count past capacity
+        stats.fill = (uint32_t)std::min(enqueued - dequeued, mMask + 1);
+        stats.highWater = mHighWater.load(std::memory_order_relaxed);
+        stats.pushed = enqueued;
+        stats.dropped = mDropped.load(std::memory_order_relaxed);
+        stats.lastDrainLatency = mLastLatency.load(std::memory_order_relaxed) * 1e-9;
+        stats.maxDrainLatency = mMaxLatency.load(std::memory_order_relaxed) * 1e-9;
+        return stats;
+    }
+
+    // any thread, true when the next command to drain is published
+    bool ready() const {
+        uint64_t position = mDequeuePosition.load(std::memory_order_relaxed);
+        return mCells[position & mMask].sequence.load(std::memory_order_acquire) == position + 1;
+    }
+
+    // Consumer. Calls `process(command)` for every command published so far, in order, up to one lap
+    // of the queue so producers that keep pushing cannot hold the consumer here. Returns the number of commands.
+    template <typename Process>
+    uint32_t drain(Process &&process) {
+        uint64_t position = mDequeuePosition.load(std::memory_order_relaxed);
+        if (mCells[position & mMask].sequence.load(std::memory_order_acquire) != position + 1) return 0;
+
+        uint64_t drained = now();
+        uint64_t latency = drained - std::min(drained, mPendingSince.load(std::memory_order_relaxed));
+        mLastLatency.store(latency, std::memory_order_relaxed);
+        if (latency > mMaxLatency.load(std::memory_order_relaxed)) {
+            mMaxLatency.store(latency, std::memory_order_relaxed);
+        }
+
+        uint32_t count = 0;
+        while (count <= mMask) {
+            Cell &cell = mCells[position & mMask];
+            if (cell.sequence.load(std::memory_order_acquire) != position + 1) break;
+            process(cell.command);
+            // Advance before freeing the cell: a producer that takes it then sees this position,
+            // so its fill never counts the cell twice.
+            mDequeuePosition.store(position + 1, std::memory_order_relaxed);
+            // free the cell for the producer one lap ahead
+            cell.sequence.store(position + mMask + 1, std::memory_order_release);
+            position++;
+            count++;
+        }
+
+        // commands pushed while this drain ran have waited at most since it started
+        mPendingSince.store(drained, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (mSpaceWanted.load() && mSpaceWanted.exchange(false) && mSpaceAvailable) {
+            mSpaceAvailable(mSpaceAvailableContext);
+        }
+        return count;
+    }
+
+private:
+    // returns false when the queue is full
+    bool enqueue(const T &command) {
+        uint64_t position = mEnqueuePosition.load(std::memory_order_relaxed);
+        while (true) {
+            Cell &cell = mCells[position & mMask];
+            uint64_t sequence = cell.sequence.load(std::memory_order_acquire);
+            int64_t difference = (int64_t)(sequence - position);
+            if (difference == 0) {
+                // the cell is free for this position, take it unless another producer got there first
+                if (mEnqueuePosition.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)) {
+                    cell.command = command;
+                    cell.sequence.store(position + 1, std::memory_order_release);
+                    noteFill(position);
+                    return true;
+                }
+            } else if (difference < 0) {
+                // the consumer has not freed the cell from the previous lap
+                return false;
+            } else {
+                position = mEnqueuePosition.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    // after claiming `position`: starts the latency clock when the queue was empty and raises the high-water mark
+    void noteFill(uint64_t position) {
+        uint64_t dequeued = mDequeuePosition.load(std::memory_order_relaxed);
+        if (position <= dequeued) {
+            mPendingSince.store(now(), std::memory_order_relaxed);
+        }
+        uint32_t fill = (uint32_t)std::min(position + 1 - std::min(position, dequeued), mMask + 1);
+        uint32_t highWater = mHighWater.load(std::memory_order_relaxed);
+        while (fill > highWater && !mHighWater.compare_exchange_weak(highWater, fill, std::memory_order_relaxed)) {}
+    }
+
+    static uint64_t now() {
+        return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    struct Cell {
+        std::atomic<uint64_t> sequence;
+        T command;
+    };
+
+    std::unique_ptr<Cell[]> mCells;
+    uint64_t mMask = 0;
+    // producers and the consumer write these, keep them on separate cache lines
+    alignas(64) std::atomic<uint64_t> mEnqueuePosition { 0 };
+    // only the consumer writes it, atomic so producers can look at it in ready()
+    alignas(64) std::atomic<uint64_t> mDequeuePosition { 0 };
+    void (*mSpaceAvailable)(void *context) = nullptr;
+    void *mSpaceAvailableContext = nullptr;
+    std::atomic<bool> mSpaceWanted { false };
+    std::atomic<uint64_t> mDropped { 0 };
+    std::atomic<uint32_t> mHighWater { 0 };
+    // nanoseconds on the steady clock, mPendingSince is written by both sides, the latencies by the consumer
+    std::atomic<uint64_t> mPendingSince { 0 };
+    std::atomic<uint64_t> mLastLatency { 0 };
+    std::atomic<uint64_t> mMaxLatency { 0 };
+};
+
+#endif
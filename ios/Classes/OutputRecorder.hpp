@@ -0,0 +1,388 @@
+//
+//  OutputRecorder.hpp
+//  AUv3SequencerExample
+//
+//  Created by rumori on 2026. 10. 17..
+//
+
+#pragma once
+
+#ifdef __cplusplus
+
+#import <AudioToolbox/AudioToolbox.h>
+#import <algorithm>
+#import <atomic>
+#import <chrono>
+#import <cmath>
+#import <mutex>
+#import <stddef.h>
+#import <stdint.h>
+#import <string.h>
+#import <thread>
+#import <vector>
+#import <pthread.h>
+#import "TPCircularBuffer.h"
+#import "TPCircularBuffer+AudioBufferList.h"
+
+// What the output recorder has written and lost, see OutputRecorder::stats
+struct OutputRecorderStats {
+    uint64_t framesWritten = 0;
+    // frames the render thread could not fit into the ring
+    uint64_t droppedFrames = 0;
+    // breaks in the captured sample times, and the frames missing across them
+    uint64_t gapCount = 0;
+    uint64_t gapFrames = 0;
+    // the most recent error from the file, noErr while writing works
+    OSStatus writeError = noErr;
+};
+
+// Records the mixed output of a graph to a WAV or CAF file while it plays.
+// A render notify on the output unit copies every rendered slice, with its timestamp, into a
+// TPCircularBuffer of audio buffer lists; that is a memcpy into memory mapped up front, so the render
+// thread never allocates or touches the file. A writer thread takes the audio out in large contiguous
+// chunks and streams it to the file with ExtAudioFile. The timestamps show where slices went missing,
+// because the ring was full or the host skipped ahead: the writer counts each gap and, up to
+// MAX_GAP_FILL_SECONDS, fills it with silence so the file stays aligned with the session.
+// The ring and the writer live as long as the recorder, so recording can start at any moment.
+// A recording carries on across attach: a configuration change costs the slices around it, counted as a gap.
+class OutputRecorder {
+public:
+    static constexpr double MAX_GAP_FILL_SECONDS = 1.0;
+    // frames per file write
+    static constexpr UInt32 CHUNK_FRAMES = 32768;
+
+    // `bufferSeconds` of audio can wait for the writer before the render thread starts dropping slices
+    explicit OutputRecorder(double bufferSeconds = 2.0) : mBufferSeconds(bufferSeconds) {
+        mRunning = true;
+        mWriterThread = std::thread([this] { run(); });
+    }
+
+    ~OutputRecorder() {
+        detach();
+        stop();
+        // the tap is left behind, see Tap
+        mRunning = false;
+        mWriterThread.join();
+        if (mAllocated) {
+            TPCircularBufferCleanup(&mBuffer);
+        }
+    }
+
+    OutputRecorder(const OutputRecorder &) = delete;
+    OutputRecorder &operator=(const OutputRecorder &) = delete;
+
+    // Adds the tap to `outputUnit`, capturing what it renders on its output bus 0 in that bus's stream format.
+    // Call before the unit renders, and again after a configuration change so the ring matches the new format.
+    // A recording in progress goes on in the new format; if the file cannot take it, the recording stops
+    // and the status says why.
+    OSStatus attach(AudioUnit outputUnit) {
+        detach();
+
+        AudioStreamBasicDescription format;
+        UInt32 size = sizeof(format);
+        OSStatus status = AudioUnitGetProperty(outputUnit, kAudioUnitProperty_StreamFormat, kAudioUnitScope_Input, 0, &format, &size);
+        if (status == noErr && (format.mFormatID != kAudioFormatLinearPCM || format.mBytesPerFrame == 0)) {
+            status = kAudioUnitErr_FormatNotSupported;
+        }
+        if (status != noErr) {
+            stop();
+            return status;
+        }
+
+        std::lock_guard<std::mutex> lock(mLock);
+        bool recording = mFile != nullptr;
+        if (recording) {
+            // what the old ring holds is still in the old format
+            write();
+        }
+        allocate(format);
+        if (recording) {
+            status = ExtAudioFileSetProperty(mFile, kExtAudioFileProperty_ClientDataFormat, sizeof(mFormat), &mFormat);
+            if (status != noErr) {
+                mWriteError.store(status, std::memory_order_relaxed);
+                closeFile();
+                recording = false;
+            } else {
+                // the slices rendered while detached are missing, and the new timeline may start anywhere
+                mGapCount.store(mGapCount.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+                mNextSampleTime = -1.0;
+            }
+        }
+        Tap *tap = new Tap();
+        tap->recorder.store(this);
+        OSStatus added = AudioUnitAddRenderNotify(outputUnit, renderNotify, tap);
+        if (added != noErr) {
+            delete tap;
+            closeFile();
+            return added;
+        }
+        mOutputUnit = outputUnit;
+        mTap = tap;
+        mRecording.store(recording);
+        return status;
+    }
+
+    // Returns once no capture is copying into the ring any more, so the ring can be freed or reallocated.
+    // A recording is only paused, attach resumes it.
+    void detach() {
+        if (mOutputUnit) {
+            mRecording.store(false);
+            // a notify that has not reached the tap yet finds no recorder there
+            mTap->recorder.store(nullptr);
+            AudioUnitRemoveRenderNotify(mOutputUnit, renderNotify, mTap);
+            // one that got the recorder before it went away may still be capturing on the render thread
+            while (mTap->capturing.load() > 0) {
+                std::this_thread::yield();
+            }
+            mOutputUnit = nullptr;
+            mTap = nullptr;
+        }
+    }
+
+    // Starts a new file at `url`, kAudioFileWAVEType (16-bit) or kAudioFileCAFType (32-bit float).
+    // Audio still waiting from a previous recording is discarded.
+    OSStatus start(CFURLRef url, AudioFileTypeID fileType) {
+        stop();
+        std::lock_guard<std::mutex> lock(mLock);
+        if (!mAllocated) return kAudioUnitErr_Uninitialized;
+
+        bool integer = fileType == kAudioFileWAVEType;
+        AudioStreamBasicDescription fileFormat = {};
+        fileFormat.mSampleRate = mFormat.mSampleRate;
+        fileFormat.mFormatID = kAudioFormatLinearPCM;
+        fileFormat.mFormatFlags = (integer ? kAudioFormatFlagIsSignedInteger : kAudioFormatFlagIsFloat) | kAudioFormatFlagIsPacked;
+        fileFormat.mChannelsPerFrame = mFormat.mChannelsPerFrame;
+        fileFormat.mBitsPerChannel = integer ? 16 : 32;
+        fileFormat.mFramesPerPacket = 1;
+        fileFormat.mBytesPerFrame = fileFormat.mBitsPerChannel / 8 * fileFormat.mChannelsPerFrame;
+        fileFormat.mBytesPerPacket = fileFormat.mBytesPerFrame;
+
+        ExtAudioFileRef file = nullptr;
+        OSStatus status = ExtAudioFileCreateWithURL(url, fileType, &fileFormat, nullptr, kAudioFileFlags_EraseFile, &file);
+        if (status != noErr) return status;
+        // the file converts from the format the ring holds
+        status = ExtAudioFileSetProperty(file, kExtAudioFileProperty_ClientDataFormat, sizeof(mFormat), &mFormat);
+        if (status != noErr) {
+            ExtAudioFileDispose(file);
+            return status;
+        }
+
+        discard();
+        mFile = file;
+        mNextSampleTime = -1.0;
+        mRecording.store(true, std::memory_order_release);
+        return noErr;
+    }
+
+    // writes whatever the render thread captured so far and closes the file
+    void stop() {
+        mRecording.store(false, std::memory_order_release);
+        std::lock_guard<std::mutex> lock(mLock);
+        if (mFile) {
+            write();
+            closeFile();
+        }
+    }
+
+    bool isRecording() const {
+        return mRecording.load(std::memory_order_acquire);
+    }
+
+    // any thread
+    OutputRecorderStats stats() const {
+        OutputRecorderStats stats;
+        stats.framesWritten = mFramesWritten.load(std::memory_order_relaxed);
+        stats.droppedFrames = mDroppedFrames.load(std::memory_order_relaxed);
+        stats.gapCount = mGapCount.load(std::memory_order_relaxed);
+        stats.gapFrames = mGapFrames.load(std::memory_order_relaxed);
+        stats.writeError = mWriteError.load(std::memory_order_relaxed);
+        return stats;
+    }
+
+private:
+    // The render notify's refcon. AudioUnitRemoveRenderNotify does not wait for a notify the host is
+    // already calling, so the tap outlives the recorder: it is never freed, one per attach.
+    struct Tap {
+        std::atomic<OutputRecorder *> recorder { nullptr };
+        // render notifies between taking the recorder and leaving its ring, see detach
+        std::atomic<uint32_t> capturing { 0 };
+    };
+
+    static OSStatus renderNotify(void *refCon, AudioUnitRenderActionFlags *actionFlags, const AudioTimeStamp *timestamp,
+                                 UInt32 busNumber, UInt32 frameCount, AudioBufferList *data) {
+        if ((*actionFlags & kAudioUnitRenderAction_PostRender) && !(*actionFlags & kAudioUnitRenderAction_PostRenderError) && busNumber == 0) {
+            Tap *tap = (Tap *)refCon;
+            // counted before the recorder is taken, so detach either sees the count or the notify finds no recorder
+            tap->capturing.fetch_add(1);
+            if (OutputRecorder *recorder = tap->recorder.load()) {
+                recorder->capture(data, timestamp, frameCount);
+            }
+            tap->capturing.fetch_sub(1, std::memory_order_release);
+        }
+        return noErr;
+    }
+
+    // render thread
+    void capture(const AudioBufferList *data, const AudioTimeStamp *timestamp, UInt32 frameCount) {
+        if (!mRecording.load() || !data || data->mNumberBuffers != mBufferCount) return;
+        // without a sample time there is no telling where the slice belongs
+        if (!(timestamp->mFlags & kAudioTimeStampSampleTimeValid)) return;
+        if (!TPCircularBufferCopyAudioBufferList(&mBuffer, data, timestamp, frameCount, &mFormat)) {
+            mDroppedFrames.store(mDroppedFrames.load(std::memory_order_relaxed) + frameCount, std::memory_order_relaxed);
+        }
+    }
+
+    // with mLock held, while nothing renders into the ring
+    void allocate(const AudioStreamBasicDescription &format) {
+        if (mAllocated) {
+            TPCircularBufferCleanup(&mBuffer);
+            mAllocated = false;
+        }
+        mFormat = format;
+        bool interleaved = !(format.mFormatFlags & kAudioFormatFlagIsNonInterleaved);
+        mBufferCount = interleaved ? 1 : format.mChannelsPerFrame;
+
+        // the audio itself, plus a header for every slice assuming slices as short as 64 frames
+        double frames = mBufferSeconds * format.mSampleRate;
+        double header = sizeof(TPCircularBufferABLBlockHeader) + mBufferCount * sizeof(AudioBuffer) + 16;
+        double bytes = frames * format.mBytesPerFrame * mBufferCount + frames / 64 * header;
+        mAllocated = TPCircularBufferInit(&mBuffer, (uint32_t)std::min(bytes, (double)INT32_MAX));
+
+        // one chunk per buffer, plus the zeroed chunk that fills gaps
+        UInt32 chunkBytes = CHUNK_FRAMES * format.mBytesPerFrame;
+        mChunk.assign((size_t)chunkBytes * mBufferCount, 0);
+        mSilence.assign((size_t)chunkBytes * mBufferCount, 0);
+        mChunkList = makeBufferList(mChunkListStorage, mChunk.data(), chunkBytes);
+        mSilenceList = makeBufferList(mSilenceListStorage, mSilence.data(), chunkBytes);
+    }
+
+    AudioBufferList *makeBufferList(std::vector<uint8_t> &storage, uint8_t *data, UInt32 bytesPerBuffer) {
+        storage.assign(offsetof(AudioBufferList, mBuffers) + mBufferCount * sizeof(AudioBuffer), 0);
+        AudioBufferList *list = (AudioBufferList *)storage.data();
+        list->mNumberBuffers = mBufferCount;
+        for (UInt32 i = 0; i < mBufferCount; i++) {
+            list->mBuffers[i].mNumberChannels = mBufferCount == 1 ? mFormat.mChannelsPerFrame : 1;
+            list->mBuffers[i].mDataByteSize = bytesPerBuffer;
+            list->mBuffers[i].mData = data + (size_t)i * bytesPerBuffer;
+        }
+        return list;
+    }
+
+    void run() {
+#ifdef __APPLE__
+        pthread_set_qos_class_self_np(QOS_CLASS_UTILITY, 0);
+#endif
+        while (mRunning.load(std::memory_order_acquire)) {
+            {
+                std::lock_guard<std::mutex> lock(mLock);
+                if (mFile) {
+                    write();
+                } else if (mAllocated) {
+                    // a slice that was captured as a recording stopped
+                    discard();
+                }
+            }
+            std::this_thread::sleep_for(std::chrono::milliseconds(50));
+        }
+    }
+
+    // with mLock held, moves everything captured so far into the file
+    void write() {
+        while (true) {
+            AudioTimeStamp timestamp;
+            UInt32 frames = TPCircularBufferPeekContiguous(&mBuffer, &timestamp, &mFormat, 0);
+            if (frames == 0) break;
+
+            if (mNextSampleTime >= 0.0 && std::fabs(timestamp.mSampleTime - mNextSampleTime) > 0.5) {
+                mGapCount.store(mGapCount.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+                double missing = timestamp.mSampleTime - mNextSampleTime;
+                // a jump back means the host restarted its clock, there is nothing to fill
+                if (missing > 0.0) {
+                    mGapFrames.store(mGapFrames.load(std::memory_order_relaxed) + (uint64_t)missing, std::memory_order_relaxed);
+                    writeSilence((uint64_t)std::min(missing, MAX_GAP_FILL_SECONDS * mFormat.mSampleRate));
+                }
+            }
+
+            frames = std::min(frames, CHUNK_FRAMES);
+            resetBufferList(mChunkList);
+            TPCircularBufferDequeueBufferListFrames(&mBuffer, &frames, mChunkList, nullptr, &mFormat);
+            if (frames == 0) break;
+            writeFrames(mChunkList, frames);
+            mNextSampleTime = timestamp.mSampleTime + frames;
+        }
+    }
+
+    void writeSilence(uint64_t frames) {
+        while (frames > 0) {
+            UInt32 count = (UInt32)std::min<uint64_t>(frames, CHUNK_FRAMES);
+            resetBufferList(mSilenceList);
+            writeFrames(mSilenceList, count);
+            frames -= count;
+        }
+    }
+
+    void writeFrames(AudioBufferList *list, UInt32 frames) {
+        for (UInt32 i = 0; i < list->mNumberBuffers; i++) {
+            list->mBuffers[i].mDataByteSize = frames * mFormat.mBytesPerFrame;
+        }
+        OSStatus status = ExtAudioFileWrite(mFile, frames, list);
+        if (status != noErr) {
+            mWriteError.store(status, std::memory_order_relaxed);
+            return;
+        }
+        mFramesWritten.store(mFramesWritten.load(std::memory_order_relaxed) + frames, std::memory_order_relaxed);
+    }
+
+    void resetBufferList(AudioBufferList *list) {
+        for (UInt32 i = 0; i < list->mNumberBuffers; i++) {
+            list->mBuffers[i].mDataByteSize = CHUNK_FRAMES * mFormat.mBytesPerFrame;
+        }
+    }
+
+    // consumer side, drops everything in the ring
+    void discard() {
+        uint32_t available;
+        if (TPCircularBufferTail(&mBuffer, &available)) {
+            TPCircularBufferConsume(&mBuffer, available);
+        }
+    }
+
+    void closeFile() {
+        mRecording.store(false, std::memory_order_release);
+        if (mFile) {
+            ExtAudioFileDispose(mFile);
+            mFile = nullptr;
+        }
+    }
+
+    double mBufferSeconds;
+    AudioUnit mOutputUnit = nullptr;
+    Tap *mTap = nullptr;
+    AudioStreamBasicDescription mFormat = {};
+    UInt32 mBufferCount = 0;
+    TPCircularBuffer mBuffer = {};
+    bool mAllocated = false;
+    std::atomic<bool> mRecording { false };
+
+    // render thread side
+    std::atomic<uint64_t> mDroppedFrames { 0 };
+
+    // writer side, everything below is guarded by mLock except the counters
+    std::mutex mLock;
+    ExtAudioFileRef mFile = nullptr;
+    double mNextSampleTime = -1.0;
+    std::vector<uint8_t> mChunk;
+    std::vector<uint8_t> mSilence;
+    std::vector<uint8_t> mChunkListStorage;
+    std::vector<uint8_t> mSilenceListStorage;
+    AudioBufferList *mChunkList = nullptr;
+    AudioBufferList *mSilenceList = nullptr;
+    std::atomic<uint64_t> mFramesWritten { 0 };
+    std::atomic<uint64_t> mGapCount { 0 };
+    std::atomic<uint64_t> mGapFrames { 0 };
+    std::atomic<OSStatus> mWriteError { noErr };
+    std::atomic<bool> mRunning { false };
+    std::thread mWriterThread;
+};
+
+#endif
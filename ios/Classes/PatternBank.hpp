@@ -0,0 +1,78 @@
+//
+//  PatternBank.hpp
+//  AUv3SequencerExample
+//
+//  Created by rumori on 2026. 10. 17..
+//
+
+#pragma once
+
+#ifdef __cplusplus
+
+#import <algorithm>
+#import <memory>
+#import <stdint.h>
+#import <vector>
+#import "MIDISequence.hpp"
+
+// the most patterns a bank can hold
+static constexpr uint32_t SEQUENCER_MAX_PATTERNS = 16;
+
+// Every pattern the sequencer can play, already in playable form, plus the queue of patterns to play next.
+// Published as a whole; patterns that did not change are shared with the previous bank rather than copied.
+class PatternBank {
+public:
+    PatternBank() {
+        std::shared_ptr<const MIDISequence> empty = std::make_shared<MIDISequence>();
+        for (auto &pattern : mPatterns) {
+            pattern = empty;
+        }
+    }
+
+    const MIDISequence &pattern(uint32_t index) const {
+        return *mPatterns[std::min(index, SEQUENCER_MAX_PATTERNS - 1)];
+    }
+
+    // control thread, before publishing
+    void setPattern(uint32_t index, std::shared_ptr<const MIDISequence> pattern) {
+        if (index < SEQUENCER_MAX_PATTERNS) {
+            mPatterns[index] = std::move(pattern);
+        }
+    }
+
+    // Queue positions count every entry ever queued, so a reader's position stays meaningful
+    // across publishes. Entries dropped by clearQueue before they played are skipped.
+    void queuePattern(uint32_t index) {
+        mQueue.push_back(std::min(index, SEQUENCER_MAX_PATTERNS - 1));
+    }
+
+    void clearQueue() {
+        mQueueStart += mQueue.size();
+        mQueue.clear();
+    }
+
+    // Drops the entries before `position` once the player is past them, so the copy every publish makes
+    // stays as small as the entries still to come. A reader behind `position` skips them like cleared ones.
+    void trimQueue(uint64_t position) {
+        if (position <= mQueueStart) return;
+        size_t count = (size_t)std::min<uint64_t>(position - mQueueStart, mQueue.size());
+        mQueue.erase(mQueue.begin(), mQueue.begin() + count);
+        mQueueStart += count;
+    }
+
+    // the entry to play after `position` entries have played, false when nothing more is queued
+    bool nextPattern(uint64_t position, uint32_t &pattern, uint64_t &nextPosition) const {
+        uint64_t entry = std::max(position, mQueueStart);
+        if (entry >= mQueueStart + mQueue.size()) return false;
+        pattern = mQueue[entry - mQueueStart];
+        nextPosition = entry + 1;
+        return true;
+    }
+
+private:
+    std::shared_ptr<const MIDISequence> mPatterns[SEQUENCER_MAX_PATTERNS];
+    uint64_t mQueueStart = 0;
+    std::vector<uint32_t> mQueue;
+};
+
+#endif
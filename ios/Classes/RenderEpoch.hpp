@@ -0,0 +1,119 @@
+//
+//  RenderEpoch.hpp
+//  AUv3SequencerExample
+//
+//  Created by rumori on 2026. 10. 17..
+//
+
+#pragma once
+
+#ifdef __cplusplus
+
+#import <atomic>
+#import <initializer_list>
+#import <stdint.h>
+#import <vector>
+
+// Counts the callbacks of one reader thread (the render thread, or a worker reading alongside it)
+// so the control thread knows when that reader can no longer be holding a pointer it loaded earlier.
+// The counter is odd while the reader is inside a callback.
+class RenderEpoch {
+public:
+    // Marks the reader as inside a callback for the lifetime of the scope.
+    class Scope {
+    public:
+        explicit Scope(RenderEpoch &epoch) : mEpoch(epoch) {
+            mEpoch.mCounter.fetch_add(1, std::memory_order_seq_cst);
+        }
+        ~Scope() {
+            mEpoch.mCounter.fetch_add(1, std::memory_order_release);
+        }
+    private:
+        RenderEpoch &mEpoch;
+    };
+
+    uint64_t current() const {
+        return mCounter.load(std::memory_order_seq_cst);
+    }
+
+    // true once no callback that was running when `snapshot` was taken is still running
+    bool hasPassed(uint64_t snapshot) const {
+        return (snapshot & 1) == 0 || mCounter.load(std::memory_order_acquire) > snapshot;
+    }
+
+private:
+    std::atomic<uint64_t> mCounter { 0 };
+};
+
+// A pointer the control thread replaces wholesale and reader threads read without locking.
+// Replaced objects are deleted once every reader has left each callback that could have loaded them.
+template <typename T>
+class EpochPointer {
+public:
+    static constexpr size_t MAX_READERS = 4;
+
+    EpochPointer(std::initializer_list<const RenderEpoch *> readers, T *initial) : mCurrent(initial) {
+        for (const RenderEpoch *reader : readers) {
+            if (mReaderCount < MAX_READERS) mReaders[mReaderCount++] = reader;
+        }
+    }
+
+    ~EpochPointer() {
+        delete mCurrent.load();
+        for (auto &retired : mRetired) {
+            delete retired.object;
+        }
+    }
+
+    EpochPointer(const EpochPointer &) = delete;
+    EpochPointer &operator=(const EpochPointer &) = delete;
+
+    // reader threads, only valid inside a RenderEpoch::Scope
+    const T *load() const {
+        return mCurrent.load(std::memory_order_seq_cst);
+    }
+
+    // control thread
+    void publish(T *next) {
+        T *previous = mCurrent.exchange(next, std::memory_order_seq_cst);
+        Retired retired = { previous, {} };
+        for (size_t i = 0; i < mReaderCount; i++) {
+            retired.epochs[i] = mReaders[i]->current();
+        }
+        mRetired.push_back(retired);
+        collect();
+    }
+
+    // control thread, frees everything the readers are done with
+    void collect() {
+        auto it = mRetired.begin();
+        while (it != mRetired.end()) {
+            if (readersHavePassed(*it)) {
+                delete it->object;
+                it = mRetired.erase(it);
+            } else {
+                ++it;
+            }
+        }
+    }
+
+private:
+    struct Retired {
+        T *object;
+        uint64_t epochs[MAX_READERS];
+    };
+
+    bool readersHavePassed(const Retired &retired) const {
+        for (size_t i = 0; i < mReaderCount; i++) {
+            if (!mReaders[i]->hasPassed(retired.epochs[i])) return false;
+        }
+        return true;
+    }
+
+    const RenderEpoch *mReaders[MAX_READERS] = {};
+    size_t mReaderCount = 0;
+    std::atomic<T *> mCurrent;
+    std::vector<Retired> mRetired;
+};
+
+#endif
@@ -0,0 +1,125 @@
+//
+//  RenderLog.hpp
+//  AUv3SequencerExample
+//
+//  Created by rumori on 2026. 10. 17..
+//
+
+#pragma once
+
+#ifdef __cplusplus
+
+#import <atomic>
+#import <chrono>
+#import <stdint.h>
+#import <stdio.h>
+#import <thread>
+#import <pthread.h>
+#import "CommandQueue.hpp"
+
+// The messages the render thread can log, each one an index into RenderLog's format table
+enum RenderLogFormat : uint16_t {
+    RenderLogNoteOn,
+    RenderLogNoteOff,
+    RenderLogFormatCount
+};
+
+// Logging for the render thread without printf's locks and allocations.
+// The render thread only copies a fixed-size record (format, arguments and sample time) into a
+// circular buffer, a background thread formats and prints whatever has arrived. When the buffer is
+// full the record is dropped and counted rather than waited for.
+class RenderLog {
+public:
+    static constexpr uint32_t MAX_ARGUMENTS = 4;
+
+    explicit RenderLog(uint32_t capacity = 16384) : mRecords(capacity / sizeof(Record)) {
+        mRunning = true;
+        mDrainThread = std::thread([this] { run(); });
+    }
+
+    ~RenderLog() {
+        mRunning = false;
+        mDrainThread.join();
+        drain();
+    }
+
+    RenderLog(const RenderLog &) = delete;
+    RenderLog &operator=(const RenderLog &) = delete;
+
+    // render thread, returns false when the record did not fit
+    bool log(RenderLogFormat format, int64_t sampleTime, int32_t a = 0, int32_t b = 0, int32_t c = 0, int32_t d = 0) {
+        uint32_t available;
+        Record *record = mRecords.reserve(available);
+        if (!record) {
+            mRecords.markDropped();
+            return false;
+        }
+        record->sampleTime = sampleTime;
+        record->format = format;
+        record->arguments[0] = a;
+        record->arguments[1] = b;
+        record->arguments[2] = c;
+        record->arguments[3] = d;
+        mRecords.commit(1);
+        return true;
+    }
+
+    uint64_t droppedCount() const {
+        return mRecords.stats().dropped;
+    }
+
+    // any thread
+    QueueStats stats() const {
+        return mRecords.stats();
+    }
+
+private:
+    struct Record {
+        int64_t sampleTime;
+        uint16_t format;
+        int32_t arguments[MAX_ARGUMENTS];
+    };
+
+    static const char *formatString(uint16_t format) {
+        // every format takes up to MAX_ARGUMENTS ints, unused ones are ignored
+        static const char *const formats[RenderLogFormatCount] = {
+            "midi event NOTE ON %d %d\n",
+            "midi event NOTE OFF %d %d\n",
+        };
+        return format < RenderLogFormatCount ? formats[format] : "unknown render log format %d\n";
+    }
+
+    void run() {
+#ifdef __APPLE__
+        pthread_set_qos_class_self_np(QOS_CLASS_UTILITY, 0);
+#endif
+        while (mRunning.load(std::memory_order_acquire)) {
+            drain();
+            std::this_thread::sleep_for(std::chrono::milliseconds(20));
+        }
+    }
+
+    void drain() {
+        mRecords.drain([](const Record *records, uint32_t count) {
+            for (uint32_t i = 0; i < count; i++) {
+                const Record &record = records[i];
+                printf("[%lld] ", (long long)record.sampleTime);
+                printf(formatString(record.format), record.arguments[0], record.arguments[1], record.arguments[2], record.arguments[3]);
+            }
+        });
+
+        uint64_t dropped = mRecords.stats().dropped;
+        if (dropped != mReportedDropped) {
+            printf("render log dropped %llu messages\n", (unsigned long long)(dropped - mReportedDropped));
+            mReportedDropped = dropped;
+        }
+    }
+
+    CommandQueue<Record> mRecords;
+    std::atomic<bool> mRunning { false };
+    std::thread mDrainThread;
+    // drain thread state
+    uint64_t mReportedDropped = 0;
+};
+
+#endif
@@ -0,0 +1,45 @@
+//
+//  RenderPolicies.hpp
+//  AUv3SequencerExample
+//
+//  Created by rumori on 2026. 10. 17..
+//
+
+#pragma once
+
+#ifdef __cplusplus
+
+#import <stdint.h>
+
+// The modes SequencerKernel::render is compiled for, one instantiation per combination.
+// Each policy is a compile-time constant, so the render path carries no checks for the modes it is not in.
+
+// where the playhead comes from
+struct InternalClockPolicy { static constexpr bool internalClock = true; };
+struct HostClockPolicy { static constexpr bool internalClock = false; };
+
+// whether patterns repeat or play a single pass
+struct LoopingPolicy { static constexpr bool looping = true; };
+struct OneShotPolicy { static constexpr bool looping = false; };
+
+// whether note ons only go out while a note is held
+struct GatedPolicy { static constexpr bool gated = true; };
+struct FreeRunningPolicy { static constexpr bool gated = false; };
+
+#ifdef SEQUENCER_RENDER_BASELINE
+// All three modes read at run time, so every check above becomes a branch again: the baseline
+// ios/Benchmarks/RenderBenchmark.mm measures the compiled modes against. Not built into the plugin.
+struct RuntimeModePolicy {
+    static inline bool internalClock = false;
+    static inline bool looping = true;
+    static inline bool gated = true;
+};
+#endif
+
+// bits of a render mode, indexing the table of render functions
+static constexpr uint32_t SEQUENCER_RENDER_INTERNAL_CLOCK = 1;
+static constexpr uint32_t SEQUENCER_RENDER_LOOPING = 2;
+static constexpr uint32_t SEQUENCER_RENDER_GATED = 4;
+static constexpr uint32_t SEQUENCER_RENDER_MODE_COUNT = 8;
+
+#endif
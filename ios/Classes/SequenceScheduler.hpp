@@ -0,0 +1,337 @@
+//
+//  SequenceScheduler.hpp
+//  AUv3SequencerExample
+//
+//  Created by rumori on 2026. 10. 17..
+//
+
+#pragma once
+
+#ifdef __cplusplus
+
+#import <algorithm>
+#import <iterator>
+#import <math.h>
+#import <stdint.h>
+#import "GrooveTemplate.hpp"
+#import "MIDISequence.hpp"
+#import "PatternBank.hpp"
+#import "TempoMap.hpp"
+
+// The stretch of the tick timeline covered by a run of frames, and how to map ticks in it back to frames.
+struct ClockWindow {
+    double startTick = 0.0;
+    double lengthInTicks = 0.0;
+    // tempo at the start of the window
+    double tempo = 120.0;
+    uint32_t frameCount = 0;
+    double sampleRate = 44100.0;
+    // set when the window follows the tempo map, otherwise the tempo is constant across the window
+    const TempoMap *tempoMap = nullptr;
+    double startSeconds = 0.0;
+    size_t *tempoHint = nullptr;
+    // ticks between the frame offsets are measured from and startTick, non-zero in a slice
+    double ticksBeforeStart = 0.0;
+
+    // a host reports one tempo per buffer
+    static ClockWindow constantTempo(double startTick, double tempo, uint32_t frameCount, double sampleRate) {
+        ClockWindow window;
+        window.startTick = startTick;
+        window.tempo = tempo;
+        window.frameCount = frameCount;
+        window.sampleRate = sampleRate;
+        window.lengthInTicks = frameCount * ticksPerSample(tempo, sampleRate);
+        return window;
+    }
+
+    // the part of the window from `fromTicks` to `toTicks`, its frame offsets still count from this window's start
+    ClockWindow slice(double fromTicks, double toTicks) const {
+        ClockWindow window = *this;
+        window.startTick = startTick + fromTicks;
+        window.lengthInTicks = toTicks - fromTicks;
+        window.ticksBeforeStart = ticksBeforeStart + fromTicks;
+        return window;
+    }
+
+    static double ticksPerSample(double tempo, double sampleRate) {
+        return tempo * SEQUENCER_PPQN / (60.0 * sampleRate);
+    }
+
+    // converts a distance from the start of the window in ticks to a frame offset,
+    // exact inside tempo ramps at O(1) per event
+    double offsetForTicks(double ticks) const {
+        double offset;
+        if (tempoMap) {
+            offset = (tempoMap->secondsAtTick(startTick + ticks, *tempoHint) - startSeconds) * sampleRate;
+        } else {
+            offset = (ticksBeforeStart + ticks) / ticksPerSample(tempo, sampleRate);
+        }
+        // keep rounding errors from pushing an event on a sample boundary into the previous frame
+        return offset + 1e-6;
+    }
+};
+
+// The status of the marker event emitted where one pattern hands over to the next,
+// never a MIDI status, the receiver releases its sounding notes there
+static constexpr uint8_t SEQUENCER_PATTERN_CHANGE = 0x00;
+// Likewise where a single pass of a pattern ends, once its longest track is over. A chord whose note off wrapped
+// around to the start of the loop would never get it otherwise.
+static constexpr uint8_t SEQUENCER_PASS_END = 0x10;
+
+// Which pattern of a bank is playing, and since when
+struct PatternPosition {
+    uint32_t pattern = 0;
+    // the tick the playing pattern's loops count from
+    int64_t origin = 0;
+    // how many queue entries have played, see PatternBank::nextPattern
+    uint64_t queuePosition = 0;
+};
+
+// The sequencer's own clock. Positions are derived from the 64-bit frame counter through the tempo map,
+// so they do not drift however long the transport runs. Plain data, so its state can be handed between threads.
+struct InternalClock {
+    // the tick reached at the end of the last window
+    double position = 0.0;
+    // the frame at which the tempo map's time starts
+    double tempoMapOrigin = 0.0;
+    uint64_t tempoRevision = 0;
+    size_t tempoHint = 0;
+    // travels with the clock, so a worker scheduling ahead and the render thread agree on it
+    PatternPosition pattern;
+
+    // the window for `frameCount` frames from `frame`, which must follow on from the previous call
+    ClockWindow advance(const TempoMap &tempoMap, uint64_t frame, uint32_t frameCount, double sampleRate) {
+        if (tempoMap.revision != tempoRevision) {
+            // anchor a new tempo map at the current position so publishing it never moves the playhead
+            tempoRevision = tempoMap.revision;
+            tempoMapOrigin = (double)frame - tempoMap.secondsAtTick(position, tempoHint) * sampleRate;
+        }
+        ClockWindow window;
+        window.frameCount = frameCount;
+        window.sampleRate = sampleRate;
+        window.tempoMap = &tempoMap;
+        window.tempoHint = &tempoHint;
+        window.startSeconds = ((double)frame - tempoMapOrigin) / sampleRate;
+        window.tempo = tempoMap.tempoAtSeconds(window.startSeconds, tempoHint);
+        window.startTick = tempoMap.tickAtSeconds(window.startSeconds, tempoHint);
+        // computed the way the next window's start will be, so the two meet exactly
+        // even when another clock copy schedules the next window
+        position = tempoMap.tickAtSeconds(((double)(frame + frameCount) - tempoMapOrigin) / sampleRate, tempoHint);
+        window.lengthInTicks = position - window.startTick;
+        return window;
+    }
+
+    // the tempo at the end of the last window
+    double tempo(const TempoMap &tempoMap) {
+        return tempoMap.tempoAtSeconds(tempoMap.secondsAtTick(position, tempoHint), tempoHint);
+    }
+};
+
+// Walks every track of a published sequence window by window, keeping a cursor per track so each window
+// only touches the events that fall inside it (plus a binary search after a jump, a loop wrap or a new sequence).
+// All tracks share the window's clock computation and only differ in where they loop.
+class SequenceScheduler {
+public:
+    // the position within a loop of `lengthInTicks`, the whole ticks are reduced with an integer
+    // modulo so precision does not depend on how long the transport has been running
+    static double loopPosition(double tick, int64_t lengthInTicks) {
+        if (lengthInTicks <= 0) return 0.0;
+        double wholeTicks = floor(tick);
+        int64_t loopTick = (int64_t)wholeTicks % lengthInTicks;
+        if (loopTick < 0) loopTick += lengthInTicks;
+        return loopTick + (tick - wholeTicks);
+    }
+
+    // Calls `emit(event, offset)` for every event of the playing pattern inside the window, with its frame
+    // offset from the window start. When another pattern is queued the window is split at the playing pattern's
+    // next loop boundary (the end of its first track) and the queued pattern starts right there,
+    // after a SEQUENCER_PATTERN_CHANGE marker.
+    // Without `Looping` every pattern plays a single pass from where it started, queued patterns still follow it,
+    // and a SEQUENCER_PASS_END marker follows the pass if nothing does.
+    template <bool Looping = true, typename Emit>
+    void schedule(const PatternBank &bank, const GrooveTemplate &groove, const ClockWindow &window, PatternPosition &position, Emit &&emit) {
+        // half a sample, so a window ending a hair before a boundary still leaves the switch to the next one
+        const double tolerance = ClockWindow::ticksPerSample(window.tempo, window.sampleRate) / 2.0;
+        double sliceStart = 0.0;
+        uint32_t nextPattern;
+        uint64_t nextQueuePosition;
+        while (bank.nextPattern(position.queuePosition, nextPattern, nextQueuePosition)) {
+            const int64_t lengthInTicks = bank.pattern(position.pattern).lengthInTicks(0);
+            double boundary = (double)position.origin;
+            if (lengthInTicks > 0) {
+                // the first boundary at or after the slice start, but never the one the pattern started at
+                double loops = ceil((window.startTick + sliceStart - position.origin - tolerance) / lengthInTicks);
+                boundary += std::max(loops, 1.0) * lengthInTicks;
+            }
+            double boundaryTicks = std::max(boundary - window.startTick, sliceStart);
+            if (boundaryTicks >= window.lengthInTicks) break;
+            scheduleSequence<Looping>(bank.pattern(position.pattern), groove, window.slice(sliceStart, boundaryTicks), position.origin, emit);
+            emit(TickEvent { (int64_t)boundary, SEQUENCER_PATTERN_CHANGE, 0, 0, 0 }, window.offsetForTicks(boundaryTicks));
+            position = { nextPattern, (int64_t)boundary, nextQueuePosition };
+            sliceStart = boundaryTicks;
+        }
+        const MIDISequence &sequence = bank.pattern(position.pattern);
+        scheduleSequence<Looping>(sequence, groove, window.slice(sliceStart, window.lengthInTicks), position.origin, emit);
+        if (!Looping) {
+            int64_t passLength = 0;
+            for (size_t track = 0; track < sequence.trackCount(); track++) {
+                passLength = std::max(passLength, sequence.lengthInTicks(track));
+            }
+            double passEndTicks = (double)(position.origin + passLength) - window.startTick;
+            if (passLength > 0 && passEndTicks >= sliceStart && passEndTicks < window.lengthInTicks) {
+                emit(TickEvent { position.origin + passLength, SEQUENCER_PASS_END, 0, 0, 0 }, window.offsetForTicks(passEndTicks));
+            }
+        }
+    }
+
+    // Calls `emit(event, offset)` for every event inside the window, with its frame offset from the window start.
+    // Events come out track by track. Loops count from `origin`. The window is in played time,
+    // `groove` maps it onto the stored events.
+    template <bool Looping = true, typename Emit>
+    void scheduleSequence(const MIDISequence &sequence, const GrooveTemplate &groove, const ClockWindow &window, int64_t origin, Emit &&emit) {
+        // the cursors are meaningless in a new sequence, and point to the wrong events under a new groove or origin,
+        // or once a single pass has left them at the end
+        if (sequence.revision != mPlayingRevision || groove.revision != mGrooveRevision || origin != mPlayingOrigin || Looping != mLooping) {
+            mPlayingRevision = sequence.revision;
+            mGrooveRevision = groove.revision;
+            mPlayingOrigin = origin;
+            mLooping = Looping;
+            mCursorsValid = false;
+        }
+
+        // only search for the first events when the playhead jumped or the sequence changed,
+        // otherwise continue from where the previous window stopped
+        bool seek = !mCursorsValid || fabs(window.startTick - mCursorPosition) > ClockWindow::ticksPerSample(window.tempo, window.sampleRate);
+        mCursorsValid = true;
+        mCursorPosition = window.startTick + window.lengthInTicks;
+        if (seek) {
+            // send every lane's value again from the new position
+            std::fill(std::begin(mLaneValues), std::end(mLaneValues), -1);
+        }
+
+        const size_t trackCount = sequence.trackCount();
+        for (size_t track = 0; track < trackCount; track++) {
+            const int64_t lengthInTicks = sequence.lengthInTicks(track);
+            if (lengthInTicks <= 0) continue;
+
+            const AutomationLane *velocityLane = sequence.velocityLane(track);
+            // a single pass is over once the window starts past the end of the track
+            double loopStart = window.startTick - origin;
+            if (!Looping && loopStart >= lengthInTicks) continue;
+            if (Looping) loopStart = loopPosition(loopStart, lengthInTicks);
+            size_t cursor = seek ? sequence.seek(track, (int64_t)ceil(groove.unwarp(loopStart, lengthInTicks))) : mCursors[track];
+
+            // walk the window one loop segment at a time, a loop transition starts a new segment at tick 0
+            double segmentStart = loopStart;
+            double remainingTicks = window.lengthInTicks;
+            double ticksBeforeSegment = 0.0;
+            while (true) {
+                // there is a loop transition in the current window when it reaches the end of the loop
+                bool loopsAround = segmentStart + remainingTicks >= lengthInTicks;
+                double segmentEnd = loopsAround ? lengthInTicks : segmentStart + remainingTicks;
+                // the difference between the tick of the event and the beginning of the window
+                // gives us the offset, converted to samples
+                double segmentOffset = ticksBeforeSegment - segmentStart;
+                double storedEnd = loopsAround ? lengthInTicks : groove.unwarp(segmentEnd, lengthInTicks);
+                cursor = sequence.consumeUntil(track, cursor, storedEnd, [&](const TickEvent &event) {
+                    double offset = window.offsetForTicks(groove.warp(event.tick, lengthInTicks) + segmentOffset);
+                    if ((event.status & 0xF0) == 0x90 && event.data2 > 0 && (velocityLane || !groove.isEmpty())) {
+                        TickEvent grooved = event;
+                        grooved.data2 = groove.velocity(event.tick, event.data2);
+                        if (velocityLane) {
+                            double scaled = grooved.data2 * std::min(std::max(velocityLane->valueAt(event.tick), 0.0), 1.0);
+                            grooved.data2 = (uint8_t)std::max(lround(scaled), 1l);
+                        }
+                        emitNotes(grooved, offset, emit);
+                    } else {
+                        emitNotes(event, offset, emit);
+                    }
+                });
+                if (!loopsAround || !Looping) break;
+                remainingTicks -= segmentEnd - segmentStart;
+                ticksBeforeSegment += segmentEnd - segmentStart;
+                segmentStart = 0.0;
+                // rewind even when the window ends right on the loop end, the next one starts at tick 0
+                cursor = sequence.trackStart(track);
+                if (remainingTicks <= 0.0) break;
+            }
+            mCursors[track] = cursor;
+        }
+
+        for (size_t lane = 0; lane < sequence.automationLaneCount(); lane++) {
+            const AutomationLane &automation = sequence.automationLane(lane);
+            if (automation.target == SEQUENCER_AUTOMATION_VELOCITY) continue;
+            scheduleLane<Looping>(automation, mLaneValues[lane], sequence.lengthInTicks(automation.track), window, origin, emit);
+        }
+    }
+
+private:
+    // Samples a controller or pitch bend lane on a grid of `maxRate` points a second, aligned to the loop
+    // so the same positions are sampled however the windows fall, and emits the points whose value differs
+    // from `lastValue`. Automation follows the played timeline, the groove does not move it.
+    template <bool Looping, typename Emit>
+    static void scheduleLane(const AutomationLane &lane, int32_t &lastValue, int64_t lengthInTicks, const ClockWindow &window, int64_t origin, Emit &emit) {
+        if (lengthInTicks <= 0 || lane.maxRate <= 0.0) return;
+        double ticksPerSecond = window.tempo / 60.0 * SEQUENCER_PPQN;
+        double step = std::max(ticksPerSecond / lane.maxRate, 1.0);
+        bool pitchBend = lane.target == SEQUENCER_AUTOMATION_PITCH_BEND;
+        uint8_t status = (pitchBend ? 0xE0 : 0xB0) | lane.channel;
+        // both ends move back by half a sample, so a point right on the edge between two windows
+        // falls into exactly one of them however the window positions were rounded
+        double tolerance = ClockWindow::ticksPerSample(window.tempo, window.sampleRate) / 2.0;
+
+        double segmentStart = window.startTick - origin;
+        if (!Looping && segmentStart >= lengthInTicks) return;
+        if (Looping) segmentStart = loopPosition(segmentStart, lengthInTicks);
+        double remainingTicks = window.lengthInTicks;
+        double ticksBeforeSegment = 0.0;
+        while (remainingTicks > 0.0) {
+            double segmentEnd = std::min(segmentStart + remainingTicks, (double)lengthInTicks);
+            for (double tick = ceil((segmentStart - tolerance) / step) * step; tick < segmentEnd - tolerance; tick += step) {
+                int32_t value = lane.quantize(lane.valueAt(tick));
+                if (value == lastValue) continue;
+                lastValue = value;
+                TickEvent event = pitchBend
+                    ? TickEvent { (int64_t)tick, status, (uint8_t)(value & 0x7F), (uint8_t)(value >> 7), lane.cable, 0 }
+                    : TickEvent { (int64_t)tick, status, (uint8_t)lane.target, (uint8_t)value, lane.cable, 0 };
+                emit(event, window.offsetForTicks(std::max(tick - segmentStart + ticksBeforeSegment, 0.0)));
+            }
+            if (!Looping) break;
+            remainingTicks -= segmentEnd - segmentStart;
+            ticksBeforeSegment += segmentEnd - segmentStart;
+            segmentStart = 0.0;
+        }
+    }
+
+    // a chord goes out as one note per tone, lowest first, anything else as it is
+    template <typename Emit>
+    static void emitNotes(const TickEvent &event, double offset, Emit &emit) {
+        if (event.intervals == 0) {
+            emit(event, offset);
+            return;
+        }
+        uint32_t intervals = event.intervals;
+        while (intervals) {
+            uint32_t interval = __builtin_ctz(intervals);
+            intervals &= intervals - 1;
+            if (event.data1 + interval > 127) break;
+            TickEvent note = event;
+            note.data1 = (uint8_t)(event.data1 + interval);
+            note.intervals = 0;
+            emit(note, offset);
+        }
+    }
+
+    size_t mCursors[SEQUENCER_MAX_TRACKS] = {};
+    // the last value each lane sent, -1 when it has to be sent again
+    int32_t mLaneValues[SEQUENCER_MAX_AUTOMATION_LANES] = {};
+    bool mCursorsValid = false;
+    uint64_t mPlayingRevision = 0;
+    uint64_t mGrooveRevision = 0;
+    int64_t mPlayingOrigin = 0;
+    bool mLooping = true;
+    // where the previous window ended on the timeline, in ticks
+    double mCursorPosition = 0.0;
+};
+
+#endif
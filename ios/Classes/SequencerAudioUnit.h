@@ -10,8 +10,14 @@
 
 #define NOTE_ON             0x90
 #define NOTE_OFF            0x80
-#define MAX_EVENT_COUNT     256
-#define BUFFER_LENGTH       16384
+
+// the number of MIDI outputs (cables) the sequencer tracks can be routed to
+#define SEQUENCER_MIDI_OUTPUT_COUNT 4
+
+// automation targets past the controller numbers 0-127
+#define SEQUENCER_AUTOMATION_PITCH_BEND 128
+// scales the velocity of the track's note ons, 1 plays them as stored
+#define SEQUENCER_AUTOMATION_VELOCITY 129
 
 typedef struct MIDIEvent {
     double timestamp;
@@ -20,23 +26,97 @@ typedef struct MIDIEvent {
     uint8_t data2;
 } MIDIEvent;
 
-typedef struct MIDISequence {
-    double length;
-    int eventCount;
-    struct MIDIEvent events[MAX_EVENT_COUNT];
-} MIDISequence;
+// A chord stored as a single event, expanded into notes while playing. Bit n of `intervals` adds
+// the note n semitones above `root`, so bit 0 is the root itself.
+typedef struct MIDIChordEvent {
+    double timestamp;
+    double duration;
+    uint8_t root;
+    uint8_t velocity;
+    uint32_t intervals;
+} MIDIChordEvent;
+
+// A breakpoint of an automation lane, `value` from 0 to 1 (0.5 is the center for pitch bend)
+typedef struct MIDIAutomationPoint {
+    double timestamp;
+    double value;
+} MIDIAutomationPoint;
+
+// Identifies an event added to the sequencer, stays valid until the event is deleted
+typedef uint64_t MIDIEventHandle;
+#define MIDIEventHandleInvalid ((MIDIEventHandle)0)
+
+// The transport as of the last rendered buffer
+typedef struct SequencerTransportState {
+    double beatPosition;
+    double loopLength;
+    double sampleTime;
+    uint64_t hostTime;
+    double tempo;
+    BOOL playing;
+    uint32_t pattern;
+} SequencerTransportState;
 
-enum SequenceOperationType { Add, Delete };
+// the queues that carry data off the render thread
+#define SEQUENCER_QUEUE_RECORDER 0
+#define SEQUENCER_QUEUE_LOG 1
+// the MIDI output collected during one render cycle, `fill` is the last cycle's events
+#define SEQUENCER_QUEUE_OUTPUT 2
+// edits waiting to be published, `dropped` counts try calls turned away because the queue was full
+#define SEQUENCER_QUEUE_EDITS 3
 
-struct SequenceOperation {
-    enum SequenceOperationType type;
-    MIDIEvent event;
-};
+// occupancy and losses of one queue, see getQueueStats:queue:
+typedef struct SequencerQueueStats {
+    uint32_t capacity;
+    uint32_t fill;
+    uint32_t highWater;
+    uint64_t pushed;
+    uint64_t dropped;
+    // seconds the oldest waiting entry sat in the queue before it was drained
+    double lastDrainLatency;
+    double maxDrainLatency;
+} SequencerQueueStats;
 
 @interface SequencerAudioUnit : AUAudioUnit
-- (void)addEvent:(MIDIEvent)event;
-- (void)deleteEvent:(MIDIEvent)event;
+- (MIDIEventHandle)addEvent:(MIDIEvent)event;
+- (MIDIEventHandle)addEvent:(MIDIEvent)event track:(NSInteger)track;
+- (MIDIEventHandle)addChord:(MIDIChordEvent)chord track:(NSInteger)track;
+- (BOOL)deleteEvent:(MIDIEventHandle)handle;
+// never wait for room in the edit queue: MIDIEventHandleInvalid or NO when it is full
+- (MIDIEventHandle)tryAddEvent:(MIDIEvent)event track:(NSInteger)track;
+- (MIDIEventHandle)tryAddChord:(MIDIChordEvent)chord track:(NSInteger)track;
+- (BOOL)tryDeleteEvent:(MIDIEventHandle)handle;
+// blocks until a publish frees room after a failed try, NO on timeout; one publish wakes one waiter
+- (BOOL)waitForEditSpace:(NSTimeInterval)timeout;
+- (void)setEvents:(const MIDIEvent *)events count:(NSInteger)count handles:(MIDIEventHandle *)handles;
+- (void)setEvents:(const MIDIEvent *)events count:(NSInteger)count handles:(MIDIEventHandle *)handles track:(NSInteger)track;
+- (void)setLength:(double)length;
+- (void)setTrackCount:(NSInteger)count;
+- (void)setLength:(double)length track:(NSInteger)track;
+- (void)setChannel:(uint8_t)channel cable:(uint8_t)cable track:(NSInteger)track;
+- (void)setAutomation:(const MIDIAutomationPoint *)points count:(NSInteger)count target:(NSInteger)target maxRate:(double)maxRate track:(NSInteger)track;
+- (void)setTempo:(double)bpm;
+- (void)addTempoEventAt:(double)beat tempo:(double)bpm ramp:(BOOL)ramp;
+- (void)setLookahead:(double)seconds;
+// units on the shared clock query the host once per render cycle between them and play in phase
+- (void)setUsesSharedClock:(BOOL)shared;
+- (void)setEditPattern:(NSInteger)pattern;
+- (void)queuePattern:(NSInteger)pattern;
+- (void)clearPatternQueue;
+- (void)setGrooveWithStepLength:(double)stepBeats timing:(const double *)timing velocity:(const int8_t *)velocity count:(NSInteger)count;
+- (void)setRecording:(BOOL)recording track:(NSInteger)track quantize:(double)quantize;
+- (void)beginEdit;
+- (void)endEdit;
 - (void)setHeldNote:(int16_t)note;
 - (void)setRepeating:(BOOL)repeating;
+// render modes, each one switches the unit to a render function compiled for it
+- (void)setFollowsHostTransport:(BOOL)follows;
+- (void)setLooping:(BOOL)looping;
+- (void)setGated:(BOOL)gated;
+// the internal clock starts over from the top with the next buffer
+- (void)restart;
 - (double)getPlayheadPosition;
+- (double)playheadPositionAtHostTime:(uint64_t)hostTime;
+- (BOOL)getTransportState:(SequencerTransportState *)state;
+- (BOOL)getQueueStats:(SequencerQueueStats *)stats queue:(NSInteger)queue;
 @end
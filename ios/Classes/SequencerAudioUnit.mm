@@ -9,7 +9,7 @@
 #import <AVFoundation/AVFoundation.h>
 #import <CoreAudioKit/AUViewController.h>
 #import <CoreMIDI/CoreMIDI.h>
-#import "TPCircularBuffer.h"
+#import <mach/mach_time.h>
 #import "SequencerKernel.hpp"
 
 @interface SequencerAudioUnit ()
@@ -24,6 +24,8 @@
 
 @implementation SequencerAudioUnit {
     SequencerKernel _kernel;
+    mach_timebase_info_data_t _timebase;
+    dispatch_semaphore_t _editSpace;
 }
 
 @synthesize parameterTree = _parameterTree;
@@ -36,11 +38,19 @@
     
     if (self == nil) { return nil; }
     
+    mach_timebase_info(&_timebase);
+    
     // TODO: these become available later for some reason
     _kernel.setMIDIOutputEventBlock(self.MIDIOutputEventBlock);
     _kernel.setMusicalContextBlock(self.musicalContextBlock);
     _kernel.setTransportStateBlock(self.transportStateBlock);
     _kernel.initialize(_outputBus.format.sampleRate);
+    
+    // the thread that publishes signals, waitForEditSpace: waits
+    _editSpace = dispatch_semaphore_create(0);
+    _kernel.setEditSpaceCallback([](void *context) {
+        dispatch_semaphore_signal((__bridge dispatch_semaphore_t)context);
+    }, (__bridge void *)_editSpace);
    
     // initialize output bus
     AVAudioFormat *format = [[AVAudioFormat alloc] initStandardFormatWithSampleRate:44100 channels:2];
@@ -110,12 +120,112 @@
 
 # pragma mark - Add/remove events
 
-- (void)addEvent:(MIDIEvent)event {
-    _kernel.addEvent(event);
+- (MIDIEventHandle)addEvent:(MIDIEvent)event {
+    return _kernel.addEvent(event);
+}
+
+- (MIDIEventHandle)addEvent:(MIDIEvent)event track:(NSInteger)track {
+    return _kernel.addEvent(event, (uint32_t)track);
+}
+
+- (MIDIEventHandle)addChord:(MIDIChordEvent)chord track:(NSInteger)track {
+    return _kernel.addChord(chord, (uint32_t)track);
+}
+
+- (BOOL)deleteEvent:(MIDIEventHandle)handle {
+    return _kernel.deleteEvent(handle);
+}
+
+- (MIDIEventHandle)tryAddEvent:(MIDIEvent)event track:(NSInteger)track {
+    return _kernel.tryAddEvent(event, (uint32_t)track);
+}
+
+- (MIDIEventHandle)tryAddChord:(MIDIChordEvent)chord track:(NSInteger)track {
+    return _kernel.tryAddChord(chord, (uint32_t)track);
+}
+
+- (BOOL)tryDeleteEvent:(MIDIEventHandle)handle {
+    return _kernel.tryDeleteEvent(handle);
+}
+
+- (BOOL)waitForEditSpace:(NSTimeInterval)timeout {
+    return dispatch_semaphore_wait(_editSpace, dispatch_time(DISPATCH_TIME_NOW, (int64_t)(timeout * NSEC_PER_SEC))) == 0;
+}
+
+- (void)setEvents:(const MIDIEvent *)events count:(NSInteger)count handles:(MIDIEventHandle *)handles {
+    _kernel.setEvents(events, count, handles);
+}
+
+- (void)setEvents:(const MIDIEvent *)events count:(NSInteger)count handles:(MIDIEventHandle *)handles track:(NSInteger)track {
+    _kernel.setEvents(events, count, handles, (uint32_t)track);
+}
+
+- (void)setLength:(double)length {
+    _kernel.setLength(length);
+}
+
+- (void)setTrackCount:(NSInteger)count {
+    _kernel.setTrackCount(count);
+}
+
+- (void)setLength:(double)length track:(NSInteger)track {
+    _kernel.setLength(length, (uint32_t)track);
+}
+
+- (void)setChannel:(uint8_t)channel cable:(uint8_t)cable track:(NSInteger)track {
+    _kernel.setTrackOutput((uint32_t)track, channel, cable);
+}
+
+- (void)setAutomation:(const MIDIAutomationPoint *)points count:(NSInteger)count target:(NSInteger)target maxRate:(double)maxRate track:(NSInteger)track {
+    _kernel.setAutomation((uint32_t)track, (uint16_t)target, points, (size_t)MAX(count, 0), maxRate);
+}
+
+- (void)setTempo:(double)bpm {
+    _kernel.setTempo(bpm);
+}
+
+- (void)addTempoEventAt:(double)beat tempo:(double)bpm ramp:(BOOL)ramp {
+    _kernel.addTempoEvent(beat, bpm, ramp);
+}
+
+- (void)setLookahead:(double)seconds {
+    _kernel.setLookahead(seconds);
+}
+
+- (void)setUsesSharedClock:(BOOL)shared {
+    _kernel.setSharedClock(shared ? &SharedClock::global() : nullptr);
+}
+
+// the bank holds 16 patterns, event and track edits go to the one selected here
+- (void)setEditPattern:(NSInteger)pattern {
+    _kernel.setEditPattern((uint32_t)pattern);
+}
+
+// starts `pattern` at the next loop boundary, queue several to play a song
+- (void)queuePattern:(NSInteger)pattern {
+    _kernel.queuePattern((uint32_t)pattern);
+}
+
+- (void)clearPatternQueue {
+    _kernel.clearPatternQueue();
 }
 
-- (void)deleteEvent:(MIDIEvent)event {
-    _kernel.deleteEvent(event);
+// timing in beats per step, applied while playing, a count of 0 removes the groove
+- (void)setGrooveWithStepLength:(double)stepBeats timing:(const double *)timing velocity:(const int8_t *)velocity count:(NSInteger)count {
+    _kernel.setGroove(stepBeats, timing, velocity, (size_t)count);
+}
+
+// notes played into the unit are merged into `track`, with note ons snapped to `quantize` beats (0 for none)
+- (void)setRecording:(BOOL)recording track:(NSInteger)track quantize:(double)quantize {
+    _kernel.setRecording(recording, (uint32_t)track, quantize);
+}
+
+- (void)beginEdit {
+    _kernel.beginEdit();
+}
+
+- (void)endEdit {
+    _kernel.endEdit();
 }
 
 - (void)setHeldNote:(int16_t)note
@@ -128,14 +238,73 @@
     _kernel.setRepeating(repeating);
 }
 
+- (void)setFollowsHostTransport:(BOOL)follows {
+    _kernel.setInternalClock(!follows);
+}
+
+- (void)setLooping:(BOOL)looping {
+    _kernel.setLooping(looping);
+}
+
+- (void)setGated:(BOOL)gated {
+    _kernel.setGated(gated);
+}
+
+- (void)restart {
+    _kernel.restart();
+}
+
 - (double)getPlayheadPosition {
-    return _kernel.getPlayheadPosition();
+    return [self playheadPositionAtHostTime:mach_absolute_time()];
+}
+
+// Extrapolates from the last rendered buffer, so it can be called at display rate without touching the render thread.
+- (double)playheadPositionAtHostTime:(uint64_t)hostTime {
+    TransportSnapshot snapshot;
+    if (!_kernel.telemetry().read(snapshot)) return 0.0;
+    double seconds = 0.0;
+    if (snapshot.hostTime != 0 && hostTime > snapshot.hostTime) {
+        seconds = (double)(hostTime - snapshot.hostTime) * _timebase.numer / _timebase.denom / NSEC_PER_SEC;
+    }
+    return snapshot.beatPositionAfter(seconds);
+}
+
+- (BOOL)getTransportState:(SequencerTransportState *)state {
+    TransportSnapshot snapshot;
+    if (!_kernel.telemetry().read(snapshot)) return NO;
+    state->beatPosition = snapshot.beatPosition;
+    state->loopLength = snapshot.loopLength;
+    state->sampleTime = snapshot.sampleTime;
+    state->hostTime = snapshot.hostTime;
+    state->tempo = snapshot.tempo;
+    state->playing = snapshot.playing;
+    state->pattern = snapshot.pattern;
+    return YES;
+}
+
+- (BOOL)getQueueStats:(SequencerQueueStats *)stats queue:(NSInteger)queue {
+    QueueStats queueStats;
+    switch (queue) {
+        case SEQUENCER_QUEUE_RECORDER: queueStats = _kernel.recorderStats(); break;
+        case SEQUENCER_QUEUE_LOG: queueStats = _kernel.logStats(); break;
+        case SEQUENCER_QUEUE_OUTPUT: queueStats = _kernel.outputStats(); break;
+        case SEQUENCER_QUEUE_EDITS: queueStats = _kernel.editStats(); break;
+        default: return NO;
+    }
+    stats->capacity = queueStats.capacity;
+    stats->fill = queueStats.fill;
+    stats->highWater = queueStats.highWater;
+    stats->pushed = queueStats.pushed;
+    stats->dropped = queueStats.dropped;
+    stats->lastDrainLatency = queueStats.lastDrainLatency;
+    stats->maxDrainLatency = queueStats.maxDrainLatency;
+    return YES;
 }
 
 #pragma mark - MIDI
 
 - (NSArray<NSString *>*) MIDIOutputNames {
-    return @[@"midiOut"];
+    return @[@"midiOut", @"midiOut 2", @"midiOut 3", @"midiOut 4"];
 }
 
 #pragma mark - AUAudioUnit (AUAudioUnitImplementation)
@@ -143,17 +312,18 @@
 - (AUInternalRenderBlock)internalRenderBlock {
     
     // cache the musical context and MIDI output blocks provided by the host
-//    __block TPCircularBuffer buffer = self->_fifoBuffer;
-    
     __block AUHostMusicalContextBlock musicalContextBlock = self.musicalContextBlock;
     __block AUMIDIOutputEventBlock midiOutputBlock = self.MIDIOutputEventBlock;
+    __block AUMIDIEventListBlock midiOutputEventListBlock = nil;
+    if (@available(iOS 15.0, macOS 12.0, *)) {
+        midiOutputEventListBlock = self.MIDIOutputEventListBlock;
+    }
     __block AUHostTransportStateBlock transportStateBlock = self.transportStateBlock;
     
     // get the current sample rate from the output bus
     __block double sampleRate = self.outputBus.format.sampleRate;
     
     __block SequencerKernel *kernel = &_kernel;
-    __block SequencerAudioUnit * audioUnit = self;
     
     return ^AUAudioUnitStatus(AudioUnitRenderActionFlags 				*actionFlags,
                               const AudioTimeStamp       				*timestamp,
@@ -164,12 +334,11 @@
                               AURenderPullInputBlock __unsafe_unretained pullInputBlock) {
 
         kernel->initialize(sampleRate);
-        kernel->setMIDIOutputEventBlock(midiOutputBlock);
+        kernel->setMIDIOutputEventBlock(midiOutputBlock, midiOutputEventListBlock);
         kernel->setMusicalContextBlock(musicalContextBlock);
         kernel->setTransportStateBlock(transportStateBlock);
-        auto result = kernel->processWithEvents(actionFlags, timestamp, frameCount, outputBusNumber, outputData, realtimeEventListHead, pullInputBlock);
-        audioUnit.playheadParameter.value = kernel->getPlayheadPosition();
-        return result;
+        // the transport state reaches the UI through the kernel's telemetry, not through a parameter
+        return kernel->processWithEvents(actionFlags, timestamp, frameCount, outputBusNumber, outputData, realtimeEventListHead, pullInputBlock);
     };
 }
 
@@ -11,19 +11,42 @@
 //#import <algorithm>
 //#import <vector>
 #import <stdio.h>
-#import "TPCircularBuffer.h"
+#import "ActiveNotes.hpp"
 #import "KeyboardState.hpp"
+#import "MIDISequence.hpp"
+#import "PatternBank.hpp"
+#import "RenderEpoch.hpp"
+#import "RenderPolicies.hpp"
+#import "SharedClock.hpp"
+#import "TempoMap.hpp"
+#import "SequenceScheduler.hpp"
+#import "LookaheadScheduler.hpp"
+#import "RenderLog.hpp"
+#import "TransportTelemetry.hpp"
+#import "UMPReader.hpp"
+#import "MIDIOutputBatch.hpp"
+#import "LiveRecorder.hpp"
+#import "CommandQueue.hpp"
+#import "MultiProducerQueue.hpp"
 
 #ifdef __cplusplus
 
+#import <condition_variable>
+#import <mutex>
+#import <thread>
+#import <unordered_map>
+#import <pthread.h>
+
+typedef ActiveNotes<SEQUENCER_MIDI_OUTPUT_COUNT> SequencerActiveNotes;
+
 class SequencerKernel {
 public:
     SequencerKernel() {
-        // initialize FIFO buffer
-        TPCircularBufferInit(&fifoBuffer, BUFFER_LENGTH);
-       
+        mPublisherRunning = true;
+        mPublisher = std::thread([this] { runPublisher(); });
+        
         // initialize sequence
-        sequence = {};
+        beginEdit();
         addEvent({0.0, 0x90, 60, 100});
         addEvent({0.1, 0x80, 60, 0});
         addEvent({1.0, 0x90, 60, 100});
@@ -32,42 +55,283 @@ public:
         addEvent({2.1, 0x80, 60, 0});
         addEvent({3.0, 0x90, 60, 100});
         addEvent({3.1, 0x80, 60, 0});
-        sequence.eventCount = 0;
-        sequence.length = 4;
+        setLength(4);
+        endEdit();
+        flushEdits();
+    }
+    
+    ~SequencerKernel() {
+        {
+            std::lock_guard<std::mutex> lock(mWakeMutex);
+            mPublisherRunning = false;
+        }
+        mWake.notify_one();
+        mPublisher.join();
+        // the worker reads the published patterns and tempo map, stop it first
+        delete mLookahead.load();
     }
     
     void initialize(double sampleRate) {
         mSampleRate = sampleRate;
     }
     
-    void addEvent(MIDIEvent event) {
-        uint32_t availableBytes = 0;
-        SequenceOperation *head = (SequenceOperation *)TPCircularBufferHead(&fifoBuffer, &availableBytes);
-        SequenceOperation op = { Add, event };
-        head = &op;
-        TPCircularBufferProduceBytes(&fifoBuffer, head, sizeof(SequenceOperation));
+    // Editing happens on a copy owned by the kernel's publisher thread. Any number of threads can edit
+    // without waiting for each other: every edit is pushed onto a lock-free queue as a command and the call
+    // returns, the publisher applies whatever has arrived and publishes it (see runPublisher).
+    // Edits from one thread stay in order; flushEdits waits until they are audible.
+    // Edits outside of beginEdit/endEdit that arrive together share a publish. Inside, the calling thread collects
+    // them and endEdit hands the whole batch to the publisher as one command, so it becomes audible at once.
+    // Batches belong to the thread that began them: other threads keep publishing meanwhile, and one that never
+    // ends its batch only holds back its own edits.
+    // A publish copies each changed pattern once: adding or deleting single events patches that copy in place,
+    // anything else (and more than MAX_PATCHED_EDITS events per pattern) collects and sorts the pattern again,
+    // so bulk changes belong inside beginEdit/endEdit or setEvents.
+    void beginEdit() {
+        std::vector<EditBatch> &batches = openBatches();
+        for (EditBatch &batch : batches) {
+            if (batch.kernel == mId) {
+                batch.depth++;
+                return;
+            }
+        }
+        batches.push_back({ mId, 1, new std::vector<EditCommand>() });
+    }
+    
+    void endEdit() {
+        std::vector<EditBatch> &batches = openBatches();
+        for (size_t i = 0; i < batches.size(); i++) {
+            if (batches[i].kernel != mId || --batches[i].depth > 0) continue;
+            EditCommand command(EditCommand::Batch);
+            command.batch = batches[i].commands;
+            batches.erase(batches.begin() + i);
+            submit(command);
+            return;
+        }
+    }
+    
+    // Event and track edits go to pattern `index` of the bank from now on, handles stay valid whichever pattern is edited.
+    // Whichever pattern is playing keeps playing.
+    void setEditPattern(uint32_t index) {
+        EditCommand command(EditCommand::SetEditPattern);
+        command.index = index;
+        submit(command);
+    }
+    
+    // Pattern `index` starts at the next loop boundary of the one playing (or of the one queued before it),
+    // queue several for a song. The last one keeps looping once the queue runs out.
+    void queuePattern(uint32_t index) {
+        EditCommand command(EditCommand::QueuePattern);
+        command.index = index;
+        submit(command);
+    }
+    
+    // drops every queued pattern that has not started yet
+    void clearPatternQueue() {
+        submit(EditCommand(EditCommand::ClearPatternQueue));
+    }
+    
+    // the handle is handed out right away, before the event is published
+    MIDIEventHandle addEvent(MIDIEvent event, uint32_t track = 0) {
+        EditCommand command(EditCommand::AddEvent);
+        command.track = track;
+        command.handle = mNextHandle.fetch_add(1, std::memory_order_relaxed);
+        command.event = event;
+        submit(command);
+        return command.handle;
+    }
+    
+    // one handle for the whole chord, deleteEvent removes all of its notes
+    MIDIEventHandle addChord(MIDIChordEvent chord, uint32_t track = 0) {
+        EditCommand command(EditCommand::AddChord);
+        command.track = track;
+        command.handle = mNextHandle.fetch_add(1, std::memory_order_relaxed);
+        command.chord = chord;
+        submit(command);
+        return command.handle;
     }
 
-    void deleteEvent(MIDIEvent event) {
-        uint32_t availableBytes = 0;
-        SequenceOperation *head = (SequenceOperation *)TPCircularBufferHead(&fifoBuffer, &availableBytes);
-        SequenceOperation op = { Delete, event };
-        head = &op;
-        TPCircularBufferProduceBytes(&fifoBuffer, head, sizeof(SequenceOperation));
+    // Like addEvent and addChord but never wait for room in the edit queue: with the queue full they return
+    // MIDIEventHandleInvalid and count the edit as dropped in editStats. The edit space callback tells when to try again.
+    MIDIEventHandle tryAddEvent(MIDIEvent event, uint32_t track = 0) {
+        EditCommand command(EditCommand::AddEvent);
+        command.track = track;
+        command.handle = mNextHandle.fetch_add(1, std::memory_order_relaxed);
+        command.event = event;
+        return trySubmit(command) ? command.handle : MIDIEventHandleInvalid;
+    }
+    
+    MIDIEventHandle tryAddChord(MIDIChordEvent chord, uint32_t track = 0) {
+        EditCommand command(EditCommand::AddChord);
+        command.track = track;
+        command.handle = mNextHandle.fetch_add(1, std::memory_order_relaxed);
+        command.chord = chord;
+        return trySubmit(command) ? command.handle : MIDIEventHandleInvalid;
+    }
+
+    // Stacked events at the same timestamp can be removed one at a time. Freeing the slot is O(1),
+    // the publish then removes the event from a copy of the playing pattern (see beginEdit).
+    // Returns false for handles this kernel never handed out; deleting an event that is already gone does nothing.
+    bool deleteEvent(MIDIEventHandle handle) {
+        if (handle == MIDIEventHandleInvalid || handle >= mNextHandle.load(std::memory_order_relaxed)) return false;
+        EditCommand command(EditCommand::DeleteEvent);
+        command.handle = handle;
+        submit(command);
+        return true;
+    }
+    
+    // like deleteEvent, also false (and counted as dropped) when the edit queue is full
+    bool tryDeleteEvent(MIDIEventHandle handle) {
+        if (handle == MIDIEventHandleInvalid || handle >= mNextHandle.load(std::memory_order_relaxed)) return false;
+        EditCommand command(EditCommand::DeleteEvent);
+        command.handle = handle;
+        return trySubmit(command);
+    }
+    
+    // Any thread. Returns once every edit made before the call is published; edits of a batch this thread
+    // has not ended yet are not part of it.
+    void flushEdits() {
+        // every edit this thread made lies below the push count; edits others were still writing only delay the return
+        uint64_t pushed = mEdits.stats().pushed;
+        while (mPublished.load(std::memory_order_acquire) < pushed) {
+            wakePublisher();
+            std::this_thread::sleep_for(std::chrono::microseconds(100));
+        }
+    }
+    
+    // Called on the publisher thread after it frees room in the edit queue that a try call wanted.
+    // Set it before editing starts.
+    void setEditSpaceCallback(void (*callback)(void *context), void *context) {
+        mEdits.setSpaceAvailableCallback(callback, context);
+    }
+    
+    // replaces a track's whole pattern with a single publish, `handles` receives one handle per event if given
+    void setEvents(const MIDIEvent *events, size_t count, MIDIEventHandle *handles, uint32_t track = 0) {
+        EditCommand command(EditCommand::SetEvents);
+        command.track = track;
+        command.handle = mNextHandle.fetch_add(count, std::memory_order_relaxed);
+        command.events = new std::vector<MIDIEvent>(events, events + count);
+        if (handles) {
+            for (size_t i = 0; i < count; i++) {
+                handles[i] = command.handle + i;
+            }
+        }
+        submit(command);
+    }
+    
+    // replaces the tempo map with a single constant tempo
+    void setTempo(double bpm) {
+        EditCommand command(EditCommand::SetTempo);
+        command.tempo = { 0, bpm, false };
+        submit(command);
+    }
+    
+    // adds or replaces the tempo change at `beat`, with `ramp` the tempo glides there from the previous change
+    void addTempoEvent(double beat, double bpm, bool ramp) {
+        EditCommand command(EditCommand::AddTempoEvent);
+        command.tempo = { MIDISequence::beatsToTicks(beat), bpm, ramp };
+        submit(command);
+    }
+    
+    // Moves scheduling of the internal clock onto a worker that runs `seconds` ahead of the playhead.
+    // 0 switches back to scheduling inside the render callback. Has no effect with a host clock.
+    // Any thread; the render thread turns the seconds into frames at its own sample rate.
+    void setLookahead(double seconds) {
+        if (seconds > 0.0 && !mLookahead.load(std::memory_order_acquire)) {
+            // concurrent callers each build a worker, only one gets installed
+            LookaheadScheduler *created = new LookaheadScheduler(mBank, mTempoMap, mGroove, mLookaheadEpoch);
+            LookaheadScheduler *expected = nullptr;
+            if (!mLookahead.compare_exchange_strong(expected, created, std::memory_order_acq_rel)) {
+                delete created;
+            }
+        }
+        mLookaheadSeconds.store(std::max(seconds, 0.0), std::memory_order_release);
+    }
+    
+    // Plays every track with a groove of `count` steps, each `stepBeats` long: step i starts `timing[i]` beats late
+    // (early when negative, at most just under half a step) and its note ons get `velocity[i]` added.
+    // The stored events are left alone, a count of 0 plays them straight again.
+    void setGroove(double stepBeats, const double *timing, const int8_t *velocity, size_t count) {
+        std::vector<GrooveStep> steps(count);
+        for (size_t i = 0; i < count; i++) {
+            steps[i] = { timing[i] * SEQUENCER_PPQN, velocity[i] };
+        }
+        EditCommand command(EditCommand::SetGroove);
+        command.groove = new GrooveTemplate();
+        command.groove->assign(MIDISequence::beatsToTicks(stepBeats), steps);
+        submit(command);
+    }
+    
+    // Tracks past the current count start out with a 4 beat loop on channel 1, cable 0.
+    // Events stay with their track when it is removed and come back if it is added again.
+    void setTrackCount(size_t count) {
+        EditCommand command(EditCommand::SetTrackCount);
+        command.count = count;
+        submit(command);
+    }
+    
+    void setLength(double length, uint32_t track = 0) {
+        EditCommand command(EditCommand::SetLength);
+        command.track = track;
+        command.length = length;
+        submit(command);
+    }
+    
+    // `channel` is 0-15, `cable` indexes MIDIOutputNames
+    void setTrackOutput(uint32_t track, uint8_t channel, uint8_t cable) {
+        EditCommand command(EditCommand::SetTrackOutput);
+        command.track = track;
+        command.output = { channel, cable };
+        submit(command);
+    }
+    
+    // Replaces the `target` lane of `track` (a controller number, SEQUENCER_AUTOMATION_PITCH_BEND or
+    // SEQUENCER_AUTOMATION_VELOCITY), no points remove it. Controller and pitch bend lanes send at most
+    // `maxRate` messages a second.
+    void setAutomation(uint32_t track, uint16_t target, const MIDIAutomationPoint *points, size_t count, double maxRate) {
+        EditCommand command(EditCommand::SetAutomation);
+        command.lane = new AutomationLane();
+        command.lane->track = track;
+        command.lane->target = target;
+        command.lane->maxRate = maxRate;
+        for (size_t i = 0; i < count; i++) {
+            command.lane->points.push_back({ MIDISequence::beatsToTicks(points[i].timestamp), points[i].value });
+        }
+        std::stable_sort(command.lane->points.begin(), command.lane->points.end(), [](const AutomationBreakpoint &a, const AutomationBreakpoint &b) {
+            return a.tick < b.tick;
+        });
+        submit(command);
+    }
+    
+    // Records incoming notes into `track` of the pattern being edited. Note ons snap to a grid of `quantize` beats
+    // (0 keeps them where they were played), note offs move along with their note on so durations are kept.
+    void setRecording(bool recording, uint32_t track = 0, double quantize = 0.0) {
+        EditCommand command(EditCommand::SetRecording);
+        command.track = track;
+        command.quantize = quantize;
+        submit(command);
+        mRecorder.setEnabled(recording);
+    }
+    
+    // Follows `clock` instead of the kernel's own frame count and host queries, nullptr leaves it.
+    // Kernels on one clock with the same tempo map play in phase. Any thread, picked up by the next buffer.
+    void setSharedClock(SharedClock *clock) {
+        mSharedClock.store(clock, std::memory_order_release);
     }
     
     void setMusicalContextBlock(AUHostMusicalContextBlock contextBlock) {
         mMusicalContextBlock = contextBlock;
     }
     
-    void setMIDIOutputEventBlock(AUMIDIOutputEventBlock midiOutputEventBlock) {
-        mMIDIOutputEventBlock = midiOutputEventBlock;
+    // with an event list block (MIDI 2.0 capable hosts) the output goes out as event lists
+    void setMIDIOutputEventBlock(AUMIDIOutputEventBlock midiOutputEventBlock, AUMIDIEventListBlock midiOutputEventListBlock = nullptr) {
+        mOutput.setOutputBlocks(midiOutputEventBlock, midiOutputEventListBlock);
     }
     
     void setTransportStateBlock(AUHostTransportStateBlock transportStateBlock) {
         mTransportStateBlock = transportStateBlock;
     }
     
+    // Renders with the function compiled for the current modes, picked once per buffer.
     AUAudioUnitStatus processWithEvents(AudioUnitRenderActionFlags                 *actionFlags,
                                         const AudioTimeStamp                       *timestamp,
                                         AVAudioFrameCount                           frameCount,
@@ -75,6 +339,32 @@ public:
                                         AudioBufferList                            *outputData,
                                         const AURenderEvent                        *realtimeEventListHead,
                                         AURenderPullInputBlock __unsafe_unretained pullInputBlock) {
+        uint32_t mode = beginRenderCycle(timestamp);
+        return (this->*renderFunctions()[mode])(actionFlags, timestamp, frameCount, outputBusNumber, outputData, realtimeEventListHead, pullInputBlock);
+    }
+    
+#ifdef SEQUENCER_RENDER_BASELINE
+    // like processWithEvents, but through the one render function that branches on the mode at run time
+    AUAudioUnitStatus processWithRuntimeMode(AudioUnitRenderActionFlags *actionFlags, const AudioTimeStamp *timestamp, AVAudioFrameCount frameCount,
+                                             NSInteger outputBusNumber, AudioBufferList *outputData, const AURenderEvent *realtimeEventListHead,
+                                             AURenderPullInputBlock __unsafe_unretained pullInputBlock) {
+        uint32_t mode = beginRenderCycle(timestamp);
+        RuntimeModePolicy::internalClock = (mode & SEQUENCER_RENDER_INTERNAL_CLOCK) != 0;
+        RuntimeModePolicy::looping = (mode & SEQUENCER_RENDER_LOOPING) != 0;
+        RuntimeModePolicy::gated = (mode & SEQUENCER_RENDER_GATED) != 0;
+        return render<RuntimeModePolicy, RuntimeModePolicy, RuntimeModePolicy>(actionFlags, timestamp, frameCount, outputBusNumber, outputData, realtimeEventListHead, pullInputBlock);
+    }
+#endif
+    
+    // The render path for one combination of RenderPolicies
+    template <typename Clock, typename Loop, typename Gate>
+    AUAudioUnitStatus render(AudioUnitRenderActionFlags                 *actionFlags,
+                             const AudioTimeStamp                       *timestamp,
+                             AVAudioFrameCount                           frameCount,
+                             NSInteger                                   outputBusNumber,
+                             AudioBufferList                            *outputData,
+                             const AURenderEvent                        *realtimeEventListHead,
+                             AURenderPullInputBlock __unsafe_unretained pullInputBlock) {
         
         // TEST MIDI
 //        mPlayheadPosition += 0.05;
@@ -88,183 +378,1018 @@ public:
 //        }
 //        return noErr;
         
-        // move MIDI events from FIFO buffer to internal sequencer buffer
-        uint32_t bytes = -1;
-        while (bytes != 0) {
-            SequenceOperation *op = (SequenceOperation *)TPCircularBufferTail(&fifoBuffer, &bytes);
-            if (op) {
-                switch (op->type) {
-                    case Add: {
-                        sequence.events[sequence.eventCount] = op->event;
-                        sequence.eventCount++;
-                        TPCircularBufferConsume(&fifoBuffer, sizeof(SequenceOperation));
-                        break;
-                    }
-                    case Delete: {
-                        for (int i = 0; i < sequence.eventCount; i++) {
-                            if (sequence.events[i].timestamp == op->event.timestamp) {
-                                for (int j = i; j < sequence.eventCount; j++) {
-                                    sequence.events[j] = sequence.events[j + 1];
-                                }
-                                sequence.eventCount--;
-                                TPCircularBufferConsume(&fifoBuffer, sizeof(SequenceOperation));
-                            }
-                        }
+        RenderEpoch::Scope epochScope(mRenderEpoch);
+        
+        // pick up the latest published patterns and tempo map
+        const PatternBank &bank = *mBank.load();
+        // the tempo map only drives the internal clock, a host brings its own
+        const TempoMap &tempoMap = *mTempoMap.load();
+        const GrooveTemplate &groove = *mGroove.load();
+        
+        auto emitEvent = [&](const TickEvent &event, double offset) {
+            // collect events for the MIDI output block provided by the host
+            AUEventSampleTime sampleTime = timestamp->mSampleTime + (AUEventSampleTime)offset;
+            uint8_t channel = event.status & 0x0F;
+            switch (event.status & 0xF0) {
+                case SEQUENCER_PATTERN_CHANGE:
+                case SEQUENCER_PASS_END: {
+                    releaseNotes(SequencerActiveNotes::allChannels(), sampleTime);
+                } break;
+                case 0x90: {
+                    // Only output notes if we are holding something
+                    if (Gate::gated && heldNote < 0) break;
+                    uint8_t velocity = event.data2;
+                    if (velocity > 0) {
+                        // the held key's dynamics carry over, scaled at its full resolution
+                        if (Gate::gated) velocity = (uint8_t)std::max((velocity * (uint32_t)heldVelocity + UINT16_MAX / 2) / UINT16_MAX, 1u);
+                        mActiveNotes.noteOn(event.cable, channel, event.data1);
+                    } else if (!mActiveNotes.noteOff(event.cable, channel, event.data1)) {
                         break;
                     }
-                }
+                    mOutput.add(sampleTime, event.cable, event.status, event.data1, velocity);
+                } break;
+                case 0x80: {
+                    // notes released by a flush already had their note off
+                    if (!mActiveNotes.noteOff(event.cable, channel, event.data1)) break;
+                    mOutput.add(sampleTime, event.cable, event.status, event.data1, event.data2);
+                } break;
+                case 0xB0:
+                case 0xE0: {
+                    // automation follows the transport, not the held note
+                    mOutput.add(sampleTime, event.cable, event.status, event.data1, event.data2);
+                } break;
             }
+        };
+        
+        // notes whose note offs an edit may have removed
+        uint64_t releasedChannels = mReleaseRequests.exchange(0, std::memory_order_acquire);
+        if (releasedChannels != 0) {
+            releaseNotes(releasedChannels, timestamp->mSampleTime);
+            // the worker may have binned note ons of the removed events already, start it over
+            mLookaheadActive = false;
         }
-
-        double tempo = 120.0;
-        double beatPosition = 0.0;
-
-        if (mInternalClock) {
-            beatPosition = totalFrameCount / (mSampleRate * 60.0 / tempo);
-            totalFrameCount += frameCount;
-        } else {
-            // get the tempo and beat position from the musical context provided by the host
-            mMusicalContextBlock(&tempo, NULL, NULL, &beatPosition, NULL, NULL);
+        // deleted events only stop their own notes, and only where they could have started them
+        uint32_t playingPattern = Clock::internalClock ? mClock.pattern.pattern : mHostPattern.pattern;
+        if (mNoteReleases.drain([&](const NoteRelease *releases, uint32_t count) {
+            for (uint32_t i = 0; i < count; i++) {
+                const NoteRelease &release = releases[i];
+                if (release.pattern != playingPattern) continue;
+                if (!mActiveNotes.noteOff(release.cable, release.channel, release.note)) continue;
+                mOutput.add(timestamp->mSampleTime, release.cable, 0x80 | release.channel, release.note, 0);
+            }
+        }) > 0) {
+            mLookaheadActive = false;
+        }
+        // blocks binned before a queue change would switch patterns at the old places, and their
+        // clocks would take back a switch the render thread made itself
+        if (mQueueRequests.exchange(false, std::memory_order_acquire)) {
+            mLookaheadActive = false;
         }
         
-        mPlayheadPosition = fmod(beatPosition, sequence.length);
-
-        bool transportMoving = false;
+        // joining or leaving a shared clock moves the playhead onto another timeline
+        SharedClock *sharedClock = mSharedClock.load(std::memory_order_acquire);
+        if (sharedClock != mActiveSharedClock) {
+            mActiveSharedClock = sharedClock;
+            releaseNotes(SequencerActiveNotes::allChannels(), timestamp->mSampleTime);
+            mLookaheadActive = false;
+            // start the tempo map at the timeline's first frame, so every kernel on it is at the same position
+            mClock.tempoRevision = tempoMap.revision;
+            mClock.tempoMapOrigin = sharedClock ? 0.0 : (double)totalFrameCount - tempoMap.secondsAtTick(mClock.position, mClock.tempoHint) * mSampleRate;
+        }
+        ClockCycle cycle;
+        if (sharedClock) {
+            // only the first kernel of the cycle asks the host
+            cycle = sharedClock->cycle(timestamp->mSampleTime, frameCount, [&](ClockCycle &next) {
+                if (!mMusicalContextBlock) return;
+                next.hostValid = mMusicalContextBlock(&next.tempo, NULL, NULL, &next.beatPosition, NULL, NULL);
+                AUHostTransportStateFlags transportStateFlags;
+                if (mTransportStateBlock && mTransportStateBlock(&transportStateFlags, NULL, NULL, NULL)) {
+                    next.moving = (transportStateFlags & AUHostTransportStateMoving) != 0;
+                }
+            });
+        }
         
-        if (mInternalClock) {
-            transportMoving = true;
-        } else {
-            AUHostTransportStateFlags transportStateFlags;
-            if (mTransportStateBlock(&transportStateFlags, NULL, NULL, NULL)) {
-                transportMoving = (transportStateFlags & AUHostTransportStateMoving) != 0;
+        // the internal clock starts over from tick 0, of the tempo map and of the playing pattern, at `frame`
+        auto restartClock = [&](uint64_t frame, AUEventSampleTime sampleTime) {
+            releaseNotes(SequencerActiveNotes::allChannels(), sampleTime);
+            PatternPosition pattern = mClock.pattern;
+            pattern.origin = 0;
+            mClock = InternalClock();
+            mClock.tempoRevision = tempoMap.revision;
+            mClock.tempoMapOrigin = (double)frame;
+            mClock.pattern = pattern;
+        };
+        
+        LookaheadScheduler *lookahead = mLookahead.load(std::memory_order_acquire);
+        double lookaheadSeconds = mLookaheadSeconds.load(std::memory_order_acquire);
+        bool useLookahead = Clock::internalClock && lookahead && lookaheadSeconds > 0.0;
+        const uint64_t bufferFrame = sharedClock ? cycle.frame : totalFrameCount;
+        
+        if (mRestartPending) {
+            mRestartPending = false;
+            if (Clock::internalClock) {
+                restartClock(bufferFrame, timestamp->mSampleTime);
+                mLookaheadActive = false;
             }
         }
         
-        if (!transportMoving) return noErr;
+        // the whole buffer's window for a host clock, sliced up below
+        ClockWindow hostWindow;
+        bool transportMoving = false;
         
-        // the length of the sequencer loop in musical time (8.0 == 8 quarter notes)
-        double lengthInSamples = sequence.length / tempo * 60. * mSampleRate;
-        double beatPositionInSamples = beatPosition / tempo * 60. * mSampleRate;
-
-        // the sample time at the start of the buffer, as given by the render block,
-        // ...modulo the length of the sequencer loop
-        double bufferStartTime = fmod(beatPositionInSamples, lengthInSamples);
-        double bufferEndTime = bufferStartTime + frameCount;
-
-        for (int i = 0; i < sequence.eventCount; i++) {
-            // get the event timestamp, given in musical time (e.g., 1.25)
-            MIDIEvent event = sequence.events[i];
-            // convert the timestamp to sample time (e.g, 55125)
-            double eventTime = event.timestamp / tempo * 60. * mSampleRate;
-            
-            bool eventIsInCurrentBuffer = eventTime >= bufferStartTime && eventTime < bufferEndTime;
-            // there is a loop transition in the current buffer
-            bool loopsAround = bufferEndTime > lengthInSamples && eventTime < fmod(bufferEndTime, lengthInSamples);
+        if (useLookahead) {
+            lookahead->setWindow((uint32_t)(lookaheadSeconds * mSampleRate));
+            if (!mLookaheadActive) {
+                lookahead->handOver(bufferFrame, mClock, mSampleRate, Loop::looping);
+                mLookaheadActive = true;
+            }
+            transportMoving = true;
+            publishTelemetry(bank, mClock.pattern, timestamp, mClock.position, mClock.tempo(tempoMap), true);
+        } else {
+            mLookaheadActive = false;
             
-            // check if the event should occur within the current buffer OR there is a loop transition
-            if (eventIsInCurrentBuffer || loopsAround) {
-                // the difference between the sample time of the event
-                // and the beginning of the buffer gives us the offset, in samples
-                double offset = eventTime - bufferStartTime;
-                
-                if (loopsAround) {
-                    // in case of a loop transitition, add the remaining frames of the current buffer to the offset
-                    double remainingFramesInBuffer = lengthInSamples - bufferStartTime;
-                    offset = eventTime + remainingFramesInBuffer;
+            if (Clock::internalClock) {
+                transportMoving = true;
+                publishTelemetry(bank, mClock.pattern, timestamp, mClock.position, mClock.tempo(tempoMap), true);
+            } else {
+                // get the tempo and beat position from the musical context provided by the host
+                double tempo = 120.0;
+                double beatPosition = 0.0;
+                if (sharedClock) {
+                    tempo = cycle.tempo;
+                    beatPosition = cycle.beatPosition;
+                    transportMoving = cycle.moving;
+                } else {
+                    // hosts without a musical context or transport (AVAudioEngine) leave the blocks nil
+                    if (mMusicalContextBlock) {
+                        mMusicalContextBlock(&tempo, NULL, NULL, &beatPosition, NULL, NULL);
+                    }
+                    AUHostTransportStateFlags transportStateFlags;
+                    if (mTransportStateBlock && mTransportStateBlock(&transportStateFlags, NULL, NULL, NULL)) {
+                        transportMoving = (transportStateFlags & AUHostTransportStateMoving) != 0;
+                    }
                 }
-               
-                // pass events to the MIDI output block provided by the host
-                AUEventSampleTime sampleTime = timestamp->mSampleTime + offset;
-                switch (event.status) {
-                    case 0x90: {
-                        // Only output notes if we are holding something
-                        if (heldNote < 0) break;
-                        uint8_t cable = 0;
-                        uint8_t midiData[] = { event.status, event.data1, event.data2 };
-                        mMIDIOutputEventBlock(sampleTime, cable, sizeof(midiData), midiData);
-                    } break;
-                    case 0x80: {
-                        uint8_t cable = 0;
-                        uint8_t midiData[] = { event.status, event.data1, event.data2 };
-                        mMIDIOutputEventBlock(sampleTime, cable, sizeof(midiData), midiData);
-                    } break;
+                hostWindow = ClockWindow::constantTempo(beatPosition * SEQUENCER_PPQN, tempo, frameCount, mSampleRate);
+                publishTelemetry(bank, mHostPattern, timestamp, hostWindow.startTick, hostWindow.tempo, transportMoving);
+                
+                // nothing will play the note offs of sounding notes once the host stops or jumps
+                bool jumped = fabs(hostWindow.startTick - mHostNextTick) > ClockWindow::ticksPerSample(tempo, mSampleRate);
+                if (mHostWasMoving && (!transportMoving || jumped)) {
+                    releaseNotes(SequencerActiveNotes::allChannels(), timestamp->mSampleTime);
                 }
+                mHostWasMoving = transportMoving;
+                mHostNextTick = hostWindow.startTick + hostWindow.lengthInTicks;
             }
         }
         
-        // MIDI
-        AURenderEvent const *nextEvent = realtimeEventListHead;
+        // schedules the sequence for `frames` frames from `offset` into the buffer
+        auto renderRange = [&](uint32_t offset, uint32_t frames) {
+            if (!transportMoving || frames == 0) return;
+            auto emitInRange = [&](const TickEvent &event, double rangeOffset) {
+                emitEvent(event, offset + rangeOffset);
+            };
+            if (useLookahead) {
+                // the worker has already placed the events, schedule directly only where it fell behind
+                lookahead->render(bufferFrame + offset, frames, mClock, emitInRange, [&](uint64_t frame, uint32_t fallbackFrames) {
+                    double fallbackOffset = (double)(frame - bufferFrame);
+                    ClockWindow window = mClock.advance(tempoMap, frame, fallbackFrames, mSampleRate);
+                    schedule<Loop>(bank, groove, window, mClock.pattern, [&](const TickEvent &event, double rangeOffset) {
+                        emitEvent(event, fallbackOffset + rangeOffset);
+                    });
+                });
+            } else if (Clock::internalClock) {
+                ClockWindow window = mClock.advance(tempoMap, bufferFrame + offset, frames, mSampleRate);
+                schedule<Loop>(bank, groove, window, mClock.pattern, emitInRange);
+            } else {
+                double ticksPerSample = ClockWindow::ticksPerSample(hostWindow.tempo, mSampleRate);
+                ClockWindow window = ClockWindow::constantTempo(hostWindow.startTick + offset * ticksPerSample, hostWindow.tempo, frames, mSampleRate);
+                schedule<Loop>(bank, groove, window, mHostPattern, emitInRange);
+            }
+        };
         
-        while(nextEvent != NULL) {
-            switch (nextEvent->head.eventType) {
-                case AURenderEventMIDI: {
-                    const AUMIDIEvent & event = nextEvent->MIDI;
-                    if (event.length == 3) {
-                        uint8_t status = event.data[0] & 0xF0;
-                        switch (status) {
-                            case 0x90: // note on
-                            {
-                                uint8_t note = event.data[1];
-                                uint8_t velocity = event.data[2];
-                                printf("midi event NOTE ON %d %d\n", note, velocity);
-                                if (velocity > 0) {
-                                    heldNotes.pressNote(note);
-                                } else {
-                                    heldNotes.releaseNote(note);
-                                }
-                                heldNote = heldNotes.firstPressedNote();
-                            } break;
-                            case 0x80: // note off
-                            {
-                                uint8_t note = event.data[1];
-                                uint8_t velocity = event.data[2];
-                                printf("midi event NOTE OFF %d %d\n", note, velocity);
-                                heldNotes.releaseNote(note);
-                                heldNote = heldNotes.firstPressedNote();
-                            } break;
-                        }
-                    }
-                } break;
-                case AURenderEventMIDIEventList:
-                    printf("midi event list\n");
-                    break;
-                default:
-                    break;
+        // the position `offset` frames into the buffer, counted from the playing pattern's origin,
+        // where incoming notes are recorded
+        bool recording = transportMoving && mRecorder.isEnabled();
+        auto tickAtOffset = [&](uint32_t offset) -> double {
+            if (Clock::internalClock) {
+                double seconds = ((double)(bufferFrame + offset) - mClock.tempoMapOrigin) / mSampleRate;
+                return tempoMap.tickAtSeconds(seconds, mClock.tempoHint) - mClock.pattern.origin;
             }
+            return hostWindow.startTick + offset * ClockWindow::ticksPerSample(hostWindow.tempo, mSampleRate) - mHostPattern.origin;
+        };
+        
+        // Split the buffer at every incoming MIDI event, so the held notes change exactly at the event's
+        // sample time and the sequence events around it are gated accordingly.
+        AURenderEvent const *nextEvent = realtimeEventListHead;
+        uint32_t position = 0;
+        while (position < frameCount) {
+            while (nextEvent != NULL && eventOffset(nextEvent, timestamp, frameCount) <= position) {
+                handleRenderEvent(nextEvent, recording, recording ? tickAtOffset(position) : 0.0);
+                nextEvent = nextEvent->head.next;
+            }
+            // gated one-shot play starts its pass over whenever the gate opens
+            bool gateOpen = heldNote >= 0;
+            if (Clock::internalClock && !Loop::looping && Gate::gated && gateOpen && !mGateWasOpen) {
+                restartClock(bufferFrame + position, timestamp->mSampleTime + position);
+                if (useLookahead) {
+                    lookahead->handOver(bufferFrame + position, mClock, mSampleRate, Loop::looping);
+                }
+            }
+            mGateWasOpen = gateOpen;
+            uint32_t rangeEnd = nextEvent != NULL ? eventOffset(nextEvent, timestamp, frameCount) : frameCount;
+            renderRange(position, rangeEnd - position);
+            position = rangeEnd;
+        }
+        // events stamped past the end of the buffer
+        while (nextEvent != NULL) {
+            handleRenderEvent(nextEvent, recording, recording ? tickAtOffset(frameCount) : 0.0);
             nextEvent = nextEvent->head.next;
         }
+        
+        if (Clock::internalClock) {
+            totalFrameCount += frameCount;
+        }
+        // the queue entries played so far, the publisher drops them from the next bank
+        mPlayedQueuePosition.store(Clock::internalClock ? mClock.pattern.queuePosition : mHostPattern.queuePosition, std::memory_order_relaxed);
+        
+        // everything the cycle produced goes to the host at once, in sample order
+        mOutput.flush();
         return noErr;
     }
     
-    double getPlayheadPosition() const {
-        return mPlayheadPosition;
+    // any thread
+    const TransportTelemetry &telemetry() const {
+        return mTelemetry;
+    }
+
+    // any thread, the queues carrying recorded notes and log records off the render thread
+    QueueStats recorderStats() const {
+        return mRecorder.stats();
+    }
+
+    QueueStats logStats() const {
+        return mLog.stats();
+    }
+
+    // any thread, the MIDI output of a render cycle: `fill` is the last cycle's events, `highWater` the most
+    // in one cycle, `dropped` the events past MIDIOutputBatch::CAPACITY or refused by an event list
+    QueueStats outputStats() const {
+        QueueStats stats;
+        stats.capacity = MIDIOutputBatch::CAPACITY;
+        stats.fill = mOutput.lastCount();
+        stats.highWater = mOutput.highWater();
+        stats.pushed = mOutput.sentCount();
+        stats.dropped = mOutput.droppedCount();
+        return stats;
+    }
+
+    // any thread, edits waiting for a publish; `dropped` counts try calls turned away by a full queue
+    QueueStats editStats() const {
+        return mEdits.stats();
     }
     
     void setHeldNote(int16_t note) {
         heldNote = note;
+        heldVelocity = UINT16_MAX;
     }
     
     void setRepeating(bool value) {
         mRepeating = value;
     }
+    
+    // Control thread. The render modes, each switch picks another render function from the next buffer on.
+    // `internal` plays on the kernel's own clock rather than the host's transport.
+    void setInternalClock(bool internal) {
+        setRenderMode(SEQUENCER_RENDER_INTERNAL_CLOCK, internal);
+    }
+    
+    // Without looping every pattern plays a single pass. On the internal clock the pass starts when one-shot
+    // play is switched on, gated it starts over whenever the gate opens, see also restart.
+    void setLooping(bool looping) {
+        setRenderMode(SEQUENCER_RENDER_LOOPING, looping);
+    }
+    
+    // Any thread. From the next buffer on, the internal clock starts over from tick 0 of the tempo map and
+    // of the playing pattern; sounding notes are released. Kernels on a shared clock fall out of phase.
+    void restart() {
+        mRestartRequests.store(true, std::memory_order_release);
+    }
+    
+    // without gating the sequence plays whether or not a note is held
+    void setGated(bool gated) {
+        setRenderMode(SEQUENCER_RENDER_GATED, gated);
+    }
 private:
+    typedef AUAudioUnitStatus (SequencerKernel::*RenderFunction)(AudioUnitRenderActionFlags *, const AudioTimeStamp *, AVAudioFrameCount,
+                                                                 NSInteger, AudioBufferList *, const AURenderEvent *, AURenderPullInputBlock);
+    
+    // indexed by render mode
+    static const RenderFunction *renderFunctions() {
+        static const RenderFunction functions[SEQUENCER_RENDER_MODE_COUNT] = {
+            &SequencerKernel::render<HostClockPolicy, OneShotPolicy, FreeRunningPolicy>,
+            &SequencerKernel::render<InternalClockPolicy, OneShotPolicy, FreeRunningPolicy>,
+            &SequencerKernel::render<HostClockPolicy, LoopingPolicy, FreeRunningPolicy>,
+            &SequencerKernel::render<InternalClockPolicy, LoopingPolicy, FreeRunningPolicy>,
+            &SequencerKernel::render<HostClockPolicy, OneShotPolicy, GatedPolicy>,
+            &SequencerKernel::render<InternalClockPolicy, OneShotPolicy, GatedPolicy>,
+            &SequencerKernel::render<HostClockPolicy, LoopingPolicy, GatedPolicy>,
+            &SequencerKernel::render<InternalClockPolicy, LoopingPolicy, GatedPolicy>,
+        };
+        return functions;
+    }
+    
+    void setRenderMode(uint32_t bit, bool enabled) {
+        if (enabled) {
+            mRenderMode.fetch_or(bit, std::memory_order_release);
+        } else {
+            mRenderMode.fetch_and(~bit, std::memory_order_release);
+        }
+    }
+    
+    // the most single event edits per pattern and publish applied to a copy of the published pattern
+    static constexpr size_t MAX_PATCHED_EDITS = 64;
+    
+    // the publisher's copy of one pattern of the bank
+    struct EditPattern {
+        EventSlotMap events;
+        std::vector<TrackSettings> tracks { TrackSettings() };
+        std::vector<AutomationLane> lanes;
+        // single event edits since the last publish, unless the whole pattern has to be rebuilt
+        std::vector<SequenceEdit> patches;
+        bool changed = false;
+    };
+    
+    // Where the publisher keeps the event behind a handle. Editing threads get their handle before the
+    // publisher has a slot for the event, so the public handles are a counter and the slot map's own
+    // generation-checked handles stay with the publisher: they find the event for patches and tell it
+    // apart from whatever reuses its slot. The lookup and its node cost the publisher, not the editing thread.
+    struct EventLocation {
+        uint32_t pattern;
+        MIDIEventHandle slot;
+    };
+    
+    // One edit on its way to the publisher. Payloads that do not fit are allocated by the editing thread
+    // and deleted by the publisher once applied.
+    struct EditCommand {
+        enum Type : uint8_t {
+            Batch, SetEditPattern, QueuePattern, ClearPatternQueue,
+            AddEvent, AddChord, DeleteEvent, SetEvents, SetTempo, AddTempoEvent, SetGroove,
+            SetTrackCount, SetLength, SetTrackOutput, SetAutomation, SetRecording, RecordEvent
+        };
+        
+        Type type;
+        uint32_t track = 0;
+        // the event's handle, the first of the range for SetEvents
+        MIDIEventHandle handle = MIDIEventHandleInvalid;
+        union {
+            MIDIEvent event;
+            MIDIChordEvent chord;
+            TempoPoint tempo;
+            RecordedEvent recorded;
+            uint32_t index;
+            size_t count;
+            double length;
+            double quantize;
+            struct { uint8_t channel; uint8_t cable; } output;
+            std::vector<EditCommand> *batch;
+            std::vector<MIDIEvent> *events;
+            AutomationLane *lane;
+            GrooveTemplate *groove;
+        };
+        
+        explicit EditCommand(Type type = Batch) : type(type) {}
+        
+        // for commands that are never applied
+        void freePayload() const {
+            switch (type) {
+                case Batch:
+                    for (const EditCommand &command : *batch) command.freePayload();
+                    delete batch;
+                    break;
+                case SetEvents: delete events; break;
+                case SetAutomation: delete lane; break;
+                case SetGroove: delete groove; break;
+                default: break;
+            }
+        }
+    };
+    
+    // the edits one thread made between beginEdit and endEdit on kernel `kernel`
+    struct EditBatch {
+        uint64_t kernel;
+        uint32_t depth;
+        std::vector<EditCommand> *commands;
+    };
+    
+    // The calling thread's open batches, on whichever kernels it is editing. Kernels are told apart by id,
+    // not address, so a batch left open on a kernel that is gone never ends up on a new one.
+    static std::vector<EditBatch> &openBatches() {
+        struct OpenBatches {
+            std::vector<EditBatch> batches;
+            // a thread that exits inside a batch drops it
+            ~OpenBatches() {
+                for (EditBatch &batch : batches) {
+                    EditCommand command(EditCommand::Batch);
+                    command.batch = batch.commands;
+                    command.freePayload();
+                }
+            }
+        };
+        static thread_local OpenBatches open;
+        return open.batches;
+    }
+    
+    // the calling thread's batch on this kernel, null outside of beginEdit/endEdit
+    std::vector<EditCommand> *openBatch() {
+        for (EditBatch &batch : openBatches()) {
+            if (batch.kernel == mId) return batch.commands;
+        }
+        return nullptr;
+    }
+    
+    static constexpr uint32_t EDIT_QUEUE_CAPACITY = 1024;
+    
+    // a note of a deleted event, to stop if it is sounding on the playing pattern
+    struct NoteRelease {
+        uint32_t pattern;
+        uint8_t cable;
+        uint8_t channel;
+        uint8_t note;
+    };
+    
+    static constexpr uint32_t NOTE_RELEASE_CAPACITY = 256;
+    
+    // the position of a render event within the buffer, events from the past or marked immediate are due at once
+    static uint32_t eventOffset(const AURenderEvent *event, const AudioTimeStamp *timestamp, uint32_t frameCount) {
+        AUEventSampleTime offset = event->head.eventSampleTime - (AUEventSampleTime)timestamp->mSampleTime;
+        if (offset <= 0) return 0;
+        return offset < frameCount ? (uint32_t)offset : frameCount;
+    }
+    
+    // with `record` set, notes are also passed to the recorder at timeline position `tick`
+    void handleRenderEvent(const AURenderEvent *renderEvent, bool record, double tick) {
+        switch (renderEvent->head.eventType) {
+            case AURenderEventMIDI: {
+                const AUMIDIEvent & event = renderEvent->MIDI;
+                if (event.length == 3) {
+                    handleChannelVoice(UMPMessage::fromMIDI1(0, event.data[0], event.data[1], event.data[2]), event.eventSampleTime, record, tick);
+                }
+            } break;
+            case AURenderEventMIDIEventList: {
+                // MIDI 2.0 hosts, read in place
+                const AUMIDIEventList & event = renderEvent->MIDIEventsList;
+                UMPReader::forEachMessage(&event.eventList, [&](const UMPMessage &message) {
+                    handleChannelVoice(message, event.eventSampleTime, record, tick);
+                });
+            } break;
+            default:
+                break;
+        }
+    }
+    
+    // MIDI 1.0 and MIDI 2.0 input both end up here, at MIDI 2.0 resolution
+    void handleChannelVoice(const UMPMessage &message, AUEventSampleTime sampleTime, bool record, double tick) {
+        if (record && (message.opcode == UMPNoteOn || message.opcode == UMPNoteOff)) {
+            uint8_t status = (message.opcode << 4) | message.channel;
+            mRecorder.record({ tick, sampleTime, status, message.index, (uint8_t)(message.velocity >> 9) });
+        }
+        switch (message.opcode) {
+            case UMPNoteOn:
+                // the log keeps MIDI 1.0 velocities
+                mLog.log(RenderLogNoteOn, sampleTime, message.index, message.velocity >> 9);
+                heldNotes.pressNote(message.index, message.velocity);
+                updateHeldNote();
+                break;
+            case UMPNoteOff:
+                mLog.log(RenderLogNoteOff, sampleTime, message.index, message.velocity >> 9);
+                heldNotes.releaseNote(message.index);
+                updateHeldNote();
+                break;
+            default:
+                break;
+        }
+    }
+    
+    // render thread, the lowest held key gates the sequence and lends it its velocity
+    void updateHeldNote() {
+        heldNote = heldNotes.firstPressedNote();
+        heldVelocity = heldNote >= 0 ? heldNotes.noteVelocity((uint8_t)heldNote) : UINT16_MAX;
+    }
+    
+    // render thread, picks up mode switches and restarts, returns the mode to render in
+    uint32_t beginRenderCycle(const AudioTimeStamp *timestamp) {
+        uint32_t mode = mRenderMode.load(std::memory_order_acquire);
+        if (mode != mActiveRenderMode) {
+            // a one-shot pass starts over when one-shot play is switched on
+            if ((mActiveRenderMode & SEQUENCER_RENDER_LOOPING) && !(mode & SEQUENCER_RENDER_LOOPING)) {
+                mRestartPending = true;
+            }
+            mActiveRenderMode = mode;
+            // the new mode may never play the note offs of the notes sounding now, e.g. on another clock
+            releaseNotes(SequencerActiveNotes::allChannels(), timestamp->mSampleTime);
+            // the worker has binned events for the previous modes
+            mLookaheadActive = false;
+        }
+        if (mRestartRequests.exchange(false, std::memory_order_acquire)) {
+            mRestartPending = true;
+        }
+        return mode;
+    }
+    
+    // The scheduler is compiled per loop mode as well, the runtime baseline picks one of the two per call.
+    template <typename Loop, typename Emit>
+    void schedule(const PatternBank &bank, const GrooveTemplate &groove, const ClockWindow &window, PatternPosition &position, Emit &&emit) {
+        if (Loop::looping) {
+            mScheduler.schedule<true>(bank, groove, window, position, emit);
+        } else {
+            mScheduler.schedule<false>(bank, groove, window, position, emit);
+        }
+    }
+    
+    // render thread, note offs for every sounding note on `channelMask`
+    void releaseNotes(uint64_t channelMask, AUEventSampleTime sampleTime) {
+        mActiveNotes.flush(channelMask, [&](uint8_t cable, uint8_t channel, uint8_t note) {
+            mOutput.add(sampleTime, cable, 0x80 | channel, note, 0);
+        });
+    }
+    
+    // publisher, the track's sounding notes are released once the edit is published
+    void releaseTrack(const EditPattern &pattern, uint32_t track) {
+        if (track >= pattern.tracks.size()) return;
+        mPendingReleases |= SequencerActiveNotes::channelBit(pattern.tracks[track].cable, pattern.tracks[track].channel);
+    }
+    
+    // Publisher, the note of a deleted note on or note off (every tone of a chord) is released once the edit
+    // is published: a note on takes its note off with it, a note off leaves its note without one.
+    void releaseEvent(uint32_t patternIndex, const SlotEvent &entry) {
+        const EditPattern &pattern = mEditPatterns[patternIndex];
+        uint8_t type = entry.event.status & 0xF0;
+        if (entry.track >= pattern.tracks.size() || (type != 0x90 && type != 0x80)) return;
+        const TrackSettings &track = pattern.tracks[entry.track];
+        uint8_t channel = track.channel & 0x0F;
+        if (entry.intervals == 0) {
+            mPendingNoteReleases.push_back({ patternIndex, track.cable, channel, entry.event.data1 });
+            return;
+        }
+        uint32_t intervals = entry.intervals;
+        while (intervals) {
+            uint32_t interval = __builtin_ctz(intervals);
+            intervals &= intervals - 1;
+            if (entry.event.data1 + interval > 127) break;
+            mPendingNoteReleases.push_back({ patternIndex, track.cable, channel, (uint8_t)(entry.event.data1 + interval) });
+        }
+    }
+    
+    // the playhead follows the first track of the playing pattern
+    void publishTelemetry(const PatternBank &bank, const PatternPosition &position, const AudioTimeStamp *timestamp, double tick, double tempo, bool playing) {
+        const MIDISequence &sequence = bank.pattern(position.pattern);
+        TransportSnapshot snapshot;
+        snapshot.beatPosition = SequenceScheduler::loopPosition(tick - position.origin, sequence.lengthInTicks(0)) / SEQUENCER_PPQN;
+        snapshot.loopLength = (double)sequence.lengthInTicks(0) / SEQUENCER_PPQN;
+        snapshot.pattern = position.pattern;
+        snapshot.sampleTime = timestamp->mSampleTime;
+        snapshot.hostTime = (timestamp->mFlags & kAudioTimeStampHostTimeValid) ? timestamp->mHostTime : 0;
+        snapshot.tempo = tempo;
+        snapshot.playing = playing;
+        mTelemetry.write(snapshot);
+    }
+    
+    // recorder thread
+    void mergeRecording(const RecordedEvent *events, uint32_t count) {
+        for (uint32_t i = 0; i < count; i++) {
+            EditCommand command(EditCommand::RecordEvent);
+            command.recorded = events[i];
+            push(command);
+        }
+        wakePublisher();
+    }
+    
+    // any thread, edits inside a batch stay with the thread until endEdit
+    void submit(const EditCommand &command) {
+        if (std::vector<EditCommand> *batch = openBatch()) {
+            batch->push_back(command);
+            return;
+        }
+        push(command);
+        wakePublisher();
+    }
+    
+    // any thread, false without waiting when the queue is full
+    bool trySubmit(const EditCommand &command) {
+        if (std::vector<EditCommand> *batch = openBatch()) {
+            batch->push_back(command);
+            return true;
+        }
+        if (!mEdits.tryPush(command)) {
+            mEdits.markDropped();
+            wakePublisher();
+            return false;
+        }
+        wakePublisher();
+        return true;
+    }
+    
+    // any thread, only waits when the queue is full, and then for the publisher rather than for other producers
+    void push(const EditCommand &command) {
+        while (!mEdits.tryPush(command)) {
+            wakePublisher();
+            std::this_thread::yield();
+        }
+    }
+    
+    // Any thread. Producers only take the lock while the publisher is going to sleep or asleep:
+    // it announces that before its last look at the queue, so either it sees the command or the producer sees it sleeping.
+    void wakePublisher() {
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (mPublisherSleeping.load(std::memory_order_relaxed)) {
+            std::lock_guard<std::mutex> lock(mWakeMutex);
+            mWakeRequested = true;
+            mWake.notify_one();
+        }
+    }
+    
+    // publisher thread, applies and publishes until the kernel goes away
+    void runPublisher() {
+#ifdef __APPLE__
+        pthread_set_qos_class_self_np(QOS_CLASS_USER_INITIATED, 0);
+#endif
+        std::unique_lock<std::mutex> lock(mWakeMutex);
+        while (mPublisherRunning) {
+            lock.unlock();
+            publishEdits();
+            lock.lock();
+            mPublisherSleeping.store(true, std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            if (!mEdits.ready()) {
+                mWake.wait(lock, [this] { return mWakeRequested || !mPublisherRunning; });
+            }
+            mWakeRequested = false;
+            mPublisherSleeping.store(false, std::memory_order_relaxed);
+        }
+        lock.unlock();
+        // commands that arrived as the kernel went away, applied so their payloads are freed
+        publishEdits();
+    }
+    
+    // publisher thread, applies every queued edit and publishes once
+    void publishEdits() {
+        while (mEdits.ready()) {
+            mApplied += mEdits.drain([this](const EditCommand &command) {
+                applyEdit(command);
+            });
+            if (mBankChanged) {
+                publishBank();
+            }
+            if (mTempoChanged) {
+                publishTempoMap();
+            }
+        }
+        mPublished.store(mApplied, std::memory_order_release);
+    }
+    
+    // publisher
+    void applyEdit(const EditCommand &command) {
+        switch (command.type) {
+            case EditCommand::Batch:
+                // edits that arrived before the batch are published on their own
+                if (mBankChanged) {
+                    publishBank();
+                }
+                for (const EditCommand &edit : *command.batch) {
+                    applyEdit(edit);
+                }
+                delete command.batch;
+                break;
+            case EditCommand::SetEditPattern:
+                mEditPattern = std::min(command.index, SEQUENCER_MAX_PATTERNS - 1);
+                break;
+            case EditCommand::QueuePattern:
+                mEditBank.queuePattern(command.index);
+                mQueueChanged = true;
+                mBankChanged = true;
+                break;
+            case EditCommand::ClearPatternQueue:
+                mEditBank.clearQueue();
+                mQueueChanged = true;
+                mBankChanged = true;
+                break;
+            case EditCommand::AddEvent:
+            case EditCommand::AddChord: {
+                EditPattern &pattern = mEditPatterns[mEditPattern];
+                MIDIEventHandle slot = command.type == EditCommand::AddEvent
+                    ? pattern.events.add(command.event, command.track, command.handle)
+                    : pattern.events.addChord(command.chord, command.track, command.handle);
+                mHandles[command.handle] = { mEditPattern, slot };
+                patchPattern(pattern, slot, true);
+                mBankChanged = true;
+                break;
+            }
+            case EditCommand::DeleteEvent: {
+                auto location = mHandles.find(command.handle);
+                if (location == mHandles.end()) break;
+                EditPattern &pattern = mEditPatterns[location->second.pattern];
+                SlotEvent entry;
+                patchPattern(pattern, location->second.slot, false);
+                if (pattern.events.get(location->second.slot, entry)) {
+                    pattern.events.remove(location->second.slot);
+                    releaseEvent(location->second.pattern, entry);
+                    mBankChanged = true;
+                }
+                mHandles.erase(location);
+                break;
+            }
+            case EditCommand::SetEvents: {
+                EditPattern &pattern = editPattern();
+                releaseTrack(pattern, command.track);
+                pattern.events.clear(command.track, [this](uint64_t key) {
+                    mHandles.erase(key);
+                });
+                for (size_t i = 0; i < command.events->size(); i++) {
+                    MIDIEventHandle handle = command.handle + i;
+                    mHandles[handle] = { mEditPattern, pattern.events.add((*command.events)[i], command.track, handle) };
+                }
+                delete command.events;
+                mBankChanged = true;
+                break;
+            }
+            case EditCommand::SetTempo:
+                mEditTempoPoints.assign(1, command.tempo);
+                mTempoChanged = true;
+                break;
+            case EditCommand::AddTempoEvent: {
+                auto position = std::lower_bound(mEditTempoPoints.begin(), mEditTempoPoints.end(), command.tempo, [](const TempoPoint &a, const TempoPoint &b) {
+                    return a.tick < b.tick;
+                });
+                if (position != mEditTempoPoints.end() && position->tick == command.tempo.tick) {
+                    *position = command.tempo;
+                } else {
+                    mEditTempoPoints.insert(position, command.tempo);
+                }
+                mTempoChanged = true;
+                break;
+            }
+            case EditCommand::SetGroove:
+                command.groove->revision = ++mGrooveRevision;
+                mGroove.publish(command.groove);
+                break;
+            case EditCommand::SetTrackCount: {
+                EditPattern &pattern = editPattern();
+                size_t count = std::min(std::max(command.count, (size_t)1), SEQUENCER_MAX_TRACKS);
+                for (size_t track = count; track < pattern.tracks.size(); track++) {
+                    releaseTrack(pattern, (uint32_t)track);
+                }
+                pattern.tracks.resize(count);
+                mBankChanged = true;
+                break;
+            }
+            case EditCommand::SetLength: {
+                EditPattern &pattern = editPattern();
+                std::vector<TrackSettings> &tracks = pattern.tracks;
+                if (command.track >= tracks.size()) break;
+                // a shorter loop can cut off note offs
+                if (command.length < tracks[command.track].length) releaseTrack(pattern, command.track);
+                tracks[command.track].length = command.length;
+                mBankChanged = true;
+                break;
+            }
+            case EditCommand::SetTrackOutput: {
+                EditPattern &pattern = editPattern();
+                std::vector<TrackSettings> &tracks = pattern.tracks;
+                if (command.track >= tracks.size()) break;
+                releaseTrack(pattern, command.track);
+                tracks[command.track].channel = command.output.channel & 0x0F;
+                tracks[command.track].cable = std::min(command.output.cable, (uint8_t)(SEQUENCER_MIDI_OUTPUT_COUNT - 1));
+                mBankChanged = true;
+                break;
+            }
+            case EditCommand::SetAutomation: {
+                AutomationLane *lane = command.lane;
+                std::vector<AutomationLane> &lanes = editPattern().lanes;
+                lanes.erase(std::remove_if(lanes.begin(), lanes.end(), [&](const AutomationLane &other) {
+                    return other.track == lane->track && other.target == lane->target;
+                }), lanes.end());
+                if (!lane->points.empty() && lane->target <= SEQUENCER_AUTOMATION_VELOCITY) {
+                    lanes.push_back(std::move(*lane));
+                }
+                delete lane;
+                mBankChanged = true;
+                break;
+            }
+            case EditCommand::SetRecording:
+                mRecordPattern = mEditPattern;
+                mRecordTrack = command.track;
+                mRecordQuantize = command.quantize;
+                break;
+            case EditCommand::RecordEvent:
+                recordEvent(command.recorded);
+                break;
+        }
+    }
+    
+    // publisher, merges one note the recorder caught into the record track
+    void recordEvent(const RecordedEvent &event) {
+        EditPattern &pattern = mEditPatterns[mRecordPattern];
+        if (mRecordTrack >= pattern.tracks.size()) return;
+        int64_t lengthInTicks = MIDISequence::beatsToTicks(pattern.tracks[mRecordTrack].length);
+        if (lengthInTicks <= 0) return;
+        double grid = mRecordQuantize * SEQUENCER_PPQN;
+        uint8_t note = event.data1 & 0x7F;
+        double tick = SequenceScheduler::loopPosition(event.tick, lengthInTicks);
+        bool noteOn = (event.status & 0xF0) == 0x90 && event.data2 > 0;
+        if (noteOn) {
+            double quantized = grid > 0.0 ? round(tick / grid) * grid : tick;
+            mRecordShift[note] = quantized - tick;
+            tick = quantized;
+        } else {
+            tick += mRecordShift[note];
+        }
+        tick = SequenceScheduler::loopPosition(tick, lengthInTicks);
+        MIDIEventHandle handle = pattern.events.add({ tick / SEQUENCER_PPQN, event.status, event.data1, event.data2 }, mRecordTrack);
+        patchPattern(pattern, handle, true);
+        mBankChanged = true;
+    }
+    
+    // the pattern edits go to, marked as changed so the next publish rebuilds it
+    EditPattern &editPattern() {
+        EditPattern &pattern = mEditPatterns[mEditPattern];
+        pattern.changed = true;
+        pattern.patches.clear();
+        return pattern;
+    }
+    
+    // Queues adding or removing the live event `handle` for the next publish (before removing it from the slots),
+    // past MAX_PATCHED_EDITS a rebuild is cheaper.
+    void patchPattern(EditPattern &pattern, MIDIEventHandle handle, bool insert) {
+        SequenceEdit edit = { {}, insert };
+        if (pattern.changed || !pattern.events.get(handle, edit.slot)) return;
+        if (pattern.patches.size() == MAX_PATCHED_EDITS) {
+            pattern.changed = true;
+            pattern.patches.clear();
+            return;
+        }
+        pattern.patches.push_back(edit);
+    }
+    
+    // Rebuilds or patches the changed patterns only, the others are shared with the previous bank.
+    // Patching copies the published pattern and applies the queued edits to the copy, with no sort.
+    void publishBank() {
+        for (uint32_t index = 0; index < SEQUENCER_MAX_PATTERNS; index++) {
+            EditPattern &pattern = mEditPatterns[index];
+            if (!pattern.changed && pattern.patches.empty()) continue;
+            std::shared_ptr<MIDISequence> next;
+            if (!pattern.changed) {
+                next = std::make_shared<MIDISequence>(mEditBank.pattern(index));
+                for (const SequenceEdit &edit : pattern.patches) {
+                    if (!next->applyEdit(edit, pattern.tracks)) {
+                        pattern.changed = true;
+                        break;
+                    }
+                }
+            }
+            if (pattern.changed) {
+                next = std::make_shared<MIDISequence>();
+                next->assign(pattern.events, pattern.tracks, pattern.lanes);
+            }
+            next->revision = ++mRevision;
+            mEditBank.setPattern(index, std::move(next));
+            pattern.changed = false;
+            pattern.patches.clear();
+        }
+        mEditBank.trimQueue(mPlayedQueuePosition.load(std::memory_order_relaxed));
+        mBank.publish(new PatternBank(mEditBank));
+        if (!mPendingNoteReleases.empty()) {
+            // the render thread is behind, stopping the whole channels instead loses no note
+            if (!mNoteReleases.tryPush(mPendingNoteReleases.data(), (uint32_t)mPendingNoteReleases.size())) {
+                for (const NoteRelease &release : mPendingNoteReleases) {
+                    mPendingReleases |= SequencerActiveNotes::channelBit(release.cable, release.channel);
+                }
+            }
+            mPendingNoteReleases.clear();
+        }
+        if (mPendingReleases != 0) {
+            mReleaseRequests.fetch_or(mPendingReleases, std::memory_order_release);
+            mPendingReleases = 0;
+        }
+        if (mQueueChanged) {
+            mQueueRequests.store(true, std::memory_order_release);
+            mQueueChanged = false;
+        }
+        mBankChanged = false;
+    }
+    
+    void publishTempoMap() {
+        mTempoChanged = false;
+        TempoMap *next = new TempoMap(120.0, SEQUENCER_PPQN);
+        next->assign(mEditTempoPoints);
+        next->revision = ++mTempoRevision;
+        mTempoMap.publish(next);
+    }
+    
     AUHostMusicalContextBlock mMusicalContextBlock;
-    AUMIDIOutputEventBlock mMIDIOutputEventBlock;
     AUHostTransportStateBlock mTransportStateBlock;
+    MIDIOutputBatch mOutput;
+    
+    // the notes the sequencer has sent note ons for, render thread only
+    SequencerActiveNotes mActiveNotes;
+    // channels whose notes the control thread wants released
+    std::atomic<uint64_t> mReleaseRequests { 0 };
+    // notes of deleted events, from the publisher to the render thread
+    CommandQueue<NoteRelease> mNoteReleases { NOTE_RELEASE_CAPACITY };
+    // set when a publish changed the pattern queue
+    std::atomic<bool> mQueueRequests { false };
+    // how many queue entries the render thread has played, see PatternBank::trimQueue
+    std::atomic<uint64_t> mPlayedQueuePosition { 0 };
+    // set by restart
+    std::atomic<bool> mRestartRequests { false };
     
     KeyboardState heldNotes;
     int16_t heldNote = -1;
+    // the held note's velocity at MIDI 2.0 resolution, gated play scales the pattern's note ons by it
+    uint16_t heldVelocity = UINT16_MAX;
     bool mRepeating = false;
     
-    bool mInternalClock = true;
-    uint32_t totalFrameCount = 0;
+    uint64_t totalFrameCount = 0;
     
-    double mPlayheadPosition = 0.0;
+    TransportTelemetry mTelemetry;
     
-    TPCircularBuffer fifoBuffer;
-    MIDISequence sequence = {};
+    // render thread state
+    InternalClock mClock;
+    // the playing pattern under a host clock, the internal clock carries its own
+    PatternPosition mHostPattern;
+    bool mHostWasMoving = false;
+    double mHostNextTick = 0.0;
+    SequenceScheduler mScheduler;
+    bool mLookaheadActive = false;
+    SharedClock *mActiveSharedClock = nullptr;
+    uint32_t mActiveRenderMode = SEQUENCER_RENDER_INTERNAL_CLOCK | SEQUENCER_RENDER_LOOPING | SEQUENCER_RENDER_GATED;
+    bool mRestartPending = false;
+    bool mGateWasOpen = false;
     
+    // tells this kernel's batches apart from other kernels' on the same thread
+    const uint64_t mId = nextKernelId();
+    static uint64_t nextKernelId() {
+        static std::atomic<uint64_t> next { 1 };
+        return next.fetch_add(1, std::memory_order_relaxed);
+    }
+    
+    // Edits from any thread, and the thread that applies and publishes them. Not a CommandQueue: that one
+    // needs a lane per producer, and editing threads come and go (UI, CoreMIDI, the recorder), so a single
+    // edit costs a compare and swap here. A batch goes in as one command however many edits it holds,
+    // written into the thread's own vector without any atomics.
+    MultiProducerQueue<EditCommand> mEdits { EDIT_QUEUE_CAPACITY };
+    std::thread mPublisher;
+    std::mutex mWakeMutex;
+    std::condition_variable mWake;
+    // guarded by mWakeMutex
+    bool mPublisherRunning = false;
+    bool mWakeRequested = false;
+    std::atomic<bool> mPublisherSleeping { false };
+    // number of edits applied, and the same as of the last publish
+    uint64_t mApplied = 0;
+    std::atomic<uint64_t> mPublished { 0 };
+    // the next handle to hand out, 0 is MIDIEventHandleInvalid
+    std::atomic<MIDIEventHandle> mNextHandle { 1 };
+    
+    // publisher thread state
+    EditPattern mEditPatterns[SEQUENCER_MAX_PATTERNS];
+    uint32_t mEditPattern = 0;
+    std::unordered_map<MIDIEventHandle, EventLocation> mHandles;
+    PatternBank mEditBank;
+    uint64_t mPendingReleases = 0;
+    std::vector<NoteRelease> mPendingNoteReleases;
+    bool mQueueChanged = false;
+    bool mBankChanged = false;
+    bool mTempoChanged = false;
+    uint64_t mRevision = 0;
+    std::vector<TempoPoint> mEditTempoPoints { { 0, 120.0, false } };
+    uint64_t mTempoRevision = 0;
+    uint64_t mGrooveRevision = 0;
+    
+    RenderEpoch mRenderEpoch;
+    RenderEpoch mLookaheadEpoch;
+    EpochPointer<PatternBank> mBank { { &mRenderEpoch, &mLookaheadEpoch }, new PatternBank() };
+    EpochPointer<TempoMap> mTempoMap { { &mRenderEpoch, &mLookaheadEpoch }, new TempoMap(120.0, SEQUENCER_PPQN) };
+    EpochPointer<GrooveTemplate> mGroove { { &mRenderEpoch, &mLookaheadEpoch }, new GrooveTemplate() };
+    
+    std::atomic<LookaheadScheduler *> mLookahead { nullptr };
+    std::atomic<double> mLookaheadSeconds { 0.0 };
+    std::atomic<SharedClock *> mSharedClock { nullptr };
+    std::atomic<uint32_t> mRenderMode { SEQUENCER_RENDER_INTERNAL_CLOCK | SEQUENCER_RENDER_LOOPING | SEQUENCER_RENDER_GATED };
+    
+    // render thread, set by initialize
     double mSampleRate = 44100.0;
+    
+    // diagnostics from the render thread, printed by a background thread
+    RenderLog mLog;
+    
+    // recording state, publisher only
+    uint32_t mRecordPattern = 0;
+    uint32_t mRecordTrack = 0;
+    double mRecordQuantize = 0.0;
+    // how far each note's last note on was moved by quantizing
+    double mRecordShift[NOTES_COUNT] = {};
+    // last, so its merge thread is stopped before the edit state goes away
+    LiveRecorder mRecorder { [this](const RecordedEvent *events, uint32_t count) { mergeRecording(events, count); } };
 };
 
 #endif
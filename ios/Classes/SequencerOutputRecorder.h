@@ -0,0 +1,36 @@
+//
+//  SequencerOutputRecorder.h
+//  AUv3SequencerExample
+//
+//  Created by rumori on 2026. 10. 17..
+//
+
+#import <AudioToolbox/AudioToolbox.h>
+#import <AVFoundation/AVFoundation.h>
+
+// what has been written and lost since the recorder was created
+typedef struct SequencerOutputRecorderStats {
+    uint64_t framesWritten;
+    // frames the render thread could not fit into the ring
+    uint64_t droppedFrames;
+    // breaks in the captured sample times and the frames missing across them, filled with silence up to a second
+    uint64_t gapCount;
+    uint64_t gapFrames;
+    OSStatus writeError;
+} SequencerOutputRecorderStats;
+
+// Records what an output unit plays to a WAV or CAF file. The render thread only copies into a ring,
+// a background thread does the file writing; the tap stays installed so recording can start at any time.
+@interface SequencerOutputRecorder : NSObject
+// `bufferDuration` seconds of audio can wait for the writer before slices are dropped
+- (instancetype)initWithOutputUnit:(AudioUnit)outputUnit bufferDuration:(NSTimeInterval)bufferDuration error:(NSError **)error;
+// After the engine changes its configuration, so the ring matches the new format. A recording in progress
+// carries on in the new format, the slices lost in between count as a gap. NO with the recording stopped
+// (`recording` turns NO) when the file cannot take the new format.
+- (BOOL)reattachToOutputUnit:(AudioUnit)outputUnit error:(NSError **)error;
+// WAV is written as 16-bit integers, anything else as a 32-bit float CAF
+- (BOOL)startRecordingToURL:(NSURL *)url error:(NSError **)error;
+- (void)stopRecording;
+@property (nonatomic, readonly) BOOL recording;
+- (void)getStats:(SequencerOutputRecorderStats *)stats;
+@end
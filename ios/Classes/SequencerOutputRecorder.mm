@@ -0,0 +1,59 @@
+//
+//  SequencerOutputRecorder.mm
+//  AUv3SequencerExample
+//
+//  Created by rumori on 2026. 10. 17..
+//
+
+#import "SequencerOutputRecorder.h"
+#import "OutputRecorder.hpp"
+#import <memory>
+
+@implementation SequencerOutputRecorder {
+    std::unique_ptr<OutputRecorder> _recorder;
+}
+
+- (instancetype)initWithOutputUnit:(AudioUnit)outputUnit bufferDuration:(NSTimeInterval)bufferDuration error:(NSError **)error {
+    self = [super init];
+    if (self == nil) { return nil; }
+
+    _recorder.reset(new OutputRecorder(bufferDuration));
+    if (![self reattachToOutputUnit:outputUnit error:error]) { return nil; }
+    return self;
+}
+
+- (BOOL)reattachToOutputUnit:(AudioUnit)outputUnit error:(NSError **)error {
+    return [self check:_recorder->attach(outputUnit) error:error];
+}
+
+- (BOOL)startRecordingToURL:(NSURL *)url error:(NSError **)error {
+    AudioFileTypeID fileType = [url.pathExtension.lowercaseString isEqualToString:@"wav"] ? kAudioFileWAVEType : kAudioFileCAFType;
+    return [self check:_recorder->start((__bridge CFURLRef)url, fileType) error:error];
+}
+
+- (void)stopRecording {
+    _recorder->stop();
+}
+
+- (BOOL)recording {
+    return _recorder->isRecording();
+}
+
+- (void)getStats:(SequencerOutputRecorderStats *)stats {
+    OutputRecorderStats recorderStats = _recorder->stats();
+    stats->framesWritten = recorderStats.framesWritten;
+    stats->droppedFrames = recorderStats.droppedFrames;
+    stats->gapCount = recorderStats.gapCount;
+    stats->gapFrames = recorderStats.gapFrames;
+    stats->writeError = recorderStats.writeError;
+}
+
+- (BOOL)check:(OSStatus)status error:(NSError **)error {
+    if (status == noErr) return YES;
+    if (error) {
+        *error = [NSError errorWithDomain:NSOSStatusErrorDomain code:status userInfo:nil];
+    }
+    return NO;
+}
+
+@end
@@ -0,0 +1,101 @@
+//
+//  SharedClock.hpp
+//  AUv3SequencerExample
+//
+//  Created by rumori on 2026. 10. 17..
+//
+
+#pragma once
+
+#ifdef __cplusplus
+
+#import <atomic>
+#import <stdint.h>
+
+// The timeline of one render cycle, the same for every kernel rendering it
+struct ClockCycle {
+    // the host's sample time of the cycle
+    double sampleTime = -1.0;
+    uint32_t frameCount = 0;
+    // frames rendered before the cycle, counted from the first cycle that used the clock
+    uint64_t frame = 0;
+    // the host's musical context, only when `hostValid`
+    double tempo = 120.0;
+    double beatPosition = 0.0;
+    bool moving = false;
+    bool hostValid = false;
+};
+
+// Lets any number of kernels follow one timeline. The first kernel to render a cycle advances the frame
+// count and asks the host for its tempo, position and transport state, every other kernel copies the
+// result, so they stay phase-locked and the host is asked once per cycle however many kernels there are.
+// Published under a sequence counter like TransportTelemetry; writers claim it with a compare and swap,
+// so nobody waits on a lock. Assumes every kernel finishes a cycle before any starts the next, as in one host graph.
+class SharedClock {
+public:
+    // the clock kernels join with SequencerKernel::setSharedClock
+    static SharedClock &global() {
+        static SharedClock clock;
+        return clock;
+    }
+
+    // Render threads. Returns the cycle starting at `sampleTime`, calling `queryHost(cycle)` to fill in
+    // the host's musical context when no other kernel has rendered it yet.
+    template <typename QueryHost>
+    ClockCycle cycle(double sampleTime, uint32_t frameCount, QueryHost &&queryHost) {
+        while (true) {
+            uint64_t sequence;
+            ClockCycle published = read(sequence);
+            if (published.sampleTime == sampleTime && published.frameCount == frameCount) return published;
+
+            ClockCycle next;
+            next.sampleTime = sampleTime;
+            next.frameCount = frameCount;
+            next.frame = sequence == 0 ? 0 : published.frame + published.frameCount;
+            queryHost(next);
+            // another kernel published in the meantime, take its cycle instead
+            if (!mSequence.compare_exchange_strong(sequence, sequence + 1, std::memory_order_acquire, std::memory_order_relaxed)) continue;
+            std::atomic_thread_fence(std::memory_order_release);
+            mSampleTime.store(next.sampleTime, std::memory_order_relaxed);
+            mFrameCount.store(next.frameCount, std::memory_order_relaxed);
+            mFrame.store(next.frame, std::memory_order_relaxed);
+            mTempo.store(next.tempo, std::memory_order_relaxed);
+            mBeatPosition.store(next.beatPosition, std::memory_order_relaxed);
+            mMoving.store(next.moving, std::memory_order_relaxed);
+            mHostValid.store(next.hostValid, std::memory_order_relaxed);
+            mSequence.store(sequence + 2, std::memory_order_release);
+            return next;
+        }
+    }
+
+private:
+    // the latest cycle and the even sequence count it was read at, 0 before the first cycle
+    ClockCycle read(uint64_t &sequence) const {
+        ClockCycle cycle;
+        while (true) {
+            sequence = mSequence.load(std::memory_order_acquire);
+            // a write is only a handful of stores
+            if (sequence & 1) continue;
+            cycle.sampleTime = mSampleTime.load(std::memory_order_relaxed);
+            cycle.frameCount = mFrameCount.load(std::memory_order_relaxed);
+            cycle.frame = mFrame.load(std::memory_order_relaxed);
+            cycle.tempo = mTempo.load(std::memory_order_relaxed);
+            cycle.beatPosition = mBeatPosition.load(std::memory_order_relaxed);
+            cycle.moving = mMoving.load(std::memory_order_relaxed);
+            cycle.hostValid = mHostValid.load(std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if (mSequence.load(std::memory_order_relaxed) == sequence) return cycle;
+        }
+    }
+
+    std::atomic<uint64_t> mSequence { 0 };
+    std::atomic<double> mSampleTime { -1.0 };
+    std::atomic<uint32_t> mFrameCount { 0 };
+    std::atomic<uint64_t> mFrame { 0 };
+    std::atomic<double> mTempo { 120.0 };
+    std::atomic<double> mBeatPosition { 0.0 };
+    std::atomic<bool> mMoving { false };
+    std::atomic<bool> mHostValid { false };
+};
+
+#endif
@@ -26,12 +26,21 @@
 //
 //  3. This notice may not be removed or altered from any source distribution.
 //
+//  Altered: adds a POSIX backend for the mirrored mapping, for platforms without Mach VM.
+//
+
+#if !defined(__APPLE__) && !defined(_GNU_SOURCE)
+#define _GNU_SOURCE // memfd_create
+#endif
 
 #include "TPCircularBuffer.h"
-#include <mach/mach.h>
 #include <stdio.h>
 #include <stdlib.h>
 
+#if defined(__APPLE__)
+
+#include <mach/mach.h>
+
 #define reportResult(result,operation) (_reportResult((result),(operation),strrchr(__FILE__, '/')+1,__LINE__))
 static inline bool _reportResult(kern_return_t result, const char *operation, const char* file, int line) {
     if ( result != ERR_SUCCESS ) {
@@ -137,6 +146,100 @@ void TPCircularBufferCleanup(TPCircularBuffer *buffer) {
     memset(buffer, 0, sizeof(TPCircularBuffer));
 }
 
+#else
+
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#define reportError(operation) (_reportError((operation),strrchr(__FILE__, '/')+1,__LINE__))
+static inline bool _reportError(const char *operation, const char* file, int line) {
+    printf("%s:%d: %s: %s\n", file, line, operation, strerror(errno));
+    return false;
+}
+
+// An anonymous shared memory object, so the same pages can be mapped twice
+static int _TPCircularBufferCreateMemory(size_t length) {
+    int fd;
+#if defined(__linux__)
+    fd = memfd_create("TPCircularBuffer", MFD_CLOEXEC);
+#else
+    // no memfd: create a uniquely named object and unlink it straight away, only the descriptor keeps it alive
+    char name[64];
+    static atomicInt counter;
+    snprintf(name, sizeof(name), "/TPCircularBuffer.%d.%d", (int)getpid(), (int)atomicFetchAdd(&counter, 1));
+    fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL, 0600);
+    if ( fd >= 0 ) shm_unlink(name);
+#endif
+    if ( fd < 0 ) return -1;
+    if ( ftruncate(fd, (off_t)length) != 0 ) {
+        int error = errno;
+        close(fd);
+        errno = error;
+        return -1;
+    }
+    return fd;
+}
+
+bool _TPCircularBufferInit(TPCircularBuffer *buffer, uint32_t length, size_t structSize) {
+    
+    assert(length > 0);
+    
+    if ( structSize != sizeof(TPCircularBuffer) ) {
+        fprintf(stderr, "TPCircularBuffer: Header version mismatch. Check for old versions of TPCircularBuffer in your project\n");
+        abort();
+    }
+    
+    // We need whole page sizes
+    size_t pageSize = (size_t)sysconf(_SC_PAGESIZE);
+    size_t roundedLength = ((size_t)length + pageSize - 1) / pageSize * pageSize;
+    if ( roundedLength > UINT32_MAX / 2 ) {
+        printf("TPCircularBuffer: length %u too large\n", length);
+        return false;
+    }
+    buffer->length = (uint32_t)roundedLength;
+    
+    int fd = _TPCircularBufferCreateMemory(buffer->length);
+    if ( fd < 0 ) return reportError("Buffer allocation");
+    
+    // Reserve twice the length of address space, so nothing else can land between the two views
+    void *reserved = mmap(NULL, (size_t)buffer->length * 2, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if ( reserved == MAP_FAILED ) {
+        reportError("Address space reservation");
+        close(fd);
+        return false;
+    }
+    
+    // Map the memory into both halves of the reservation. MAP_FIXED replaces the reserved pages in place,
+    // so unlike the Mach version there is no window for another thread to take the second half
+    char *bufferAddress = (char *)reserved;
+    if ( mmap(bufferAddress, buffer->length, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, fd, 0) == MAP_FAILED
+        || mmap(bufferAddress + buffer->length, buffer->length, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, fd, 0) == MAP_FAILED ) {
+        reportError("Map buffer memory");
+        munmap(reserved, (size_t)buffer->length * 2);
+        close(fd);
+        return false;
+    }
+    
+    // The mappings keep the memory alive
+    close(fd);
+    
+    buffer->buffer = bufferAddress;
+    buffer->fillCount = 0;
+    buffer->head = buffer->tail = 0;
+    buffer->atomic = true;
+    
+    return true;
+}
+
+void TPCircularBufferCleanup(TPCircularBuffer *buffer) {
+    munmap(buffer->buffer, (size_t)buffer->length * 2);
+    memset(buffer, 0, sizeof(TPCircularBuffer));
+}
+
+#endif
+
 void TPCircularBufferClear(TPCircularBuffer *buffer) {
     uint32_t fillCount;
     if ( TPCircularBufferTail(buffer, &fillCount) ) {
@@ -43,9 +43,15 @@
 #define TPCircularBuffer_h
 
 #include <stdbool.h>
+#include <stdint.h>
 #include <string.h>
 #include <assert.h>
 
+// Apple's cdefs provide this, elsewhere fall back to the plain attribute
+#ifndef __deprecated_msg
+#define __deprecated_msg(_msg) __attribute__((deprecated(_msg)))
+#endif
+
 #ifdef __cplusplus
     extern "C++" {
         #include <atomic>
@@ -0,0 +1,126 @@
+//
+//  TempoMap.hpp
+//  AUv3SequencerExample
+//
+//  Created by rumori on 2026. 10. 17..
+//
+
+#pragma once
+
+#ifdef __cplusplus
+
+#import <algorithm>
+#import <math.h>
+#import <stdint.h>
+#import <vector>
+
+// A tempo change on the tick timeline. When `ramp` is set the tempo glides
+// linearly (in time) from the previous point and reaches `bpm` exactly at `tick`.
+struct TempoPoint {
+    int64_t tick;
+    double bpm;
+    bool ramp;
+};
+
+// Precomputed tick <-> seconds conversion for a list of tempo points.
+// Every segment is either constant or a linear tempo ramp, both of which have a closed-form
+// integral, so converting a position costs O(1) once the segment is known.
+class TempoMap {
+public:
+    static constexpr double MIN_TEMPO = 1.0;
+
+    TempoMap(double bpm, int64_t ppqn) : mPPQN(ppqn) {
+        segments.push_back({ 0, 0.0, std::max(MIN_TEMPO, bpm), 0.0 });
+    }
+
+    // bumped on every publish, see MIDISequence::revision
+    uint64_t revision = 0;
+
+    // `points` must be sorted by tick and not empty, the first point's tempo also applies before it
+    void assign(const std::vector<TempoPoint> &points) {
+        segments.clear();
+        double seconds = 0.0;
+        int64_t tick = 0;
+        double bpm = std::max(MIN_TEMPO, points[0].bpm);
+        for (size_t i = 0; i < points.size(); i++) {
+            const TempoPoint &point = points[i];
+            double nextBpm = std::max(MIN_TEMPO, point.bpm);
+            double beats = (double)(point.tick - tick) / mPPQN;
+            if (beats > 0.0) {
+                if (point.ramp) {
+                    // the average tempo of a linear ramp is the mean of its ends
+                    double duration = 120.0 * beats / (bpm + nextBpm);
+                    segments.push_back({ tick, seconds, bpm, (nextBpm - bpm) / duration });
+                    seconds += duration;
+                } else {
+                    segments.push_back({ tick, seconds, bpm, 0.0 });
+                    seconds += 60.0 * beats / bpm;
+                }
+                tick = point.tick;
+            }
+            bpm = nextBpm;
+        }
+        segments.push_back({ tick, seconds, bpm, 0.0 });
+    }
+
+    // Both conversions take a segment index hint owned by the caller, so walking forwards
+    // through time (the render thread, buffer by buffer) never searches.
+    double secondsAtTick(double tick, size_t &hint) const {
+        const Segment &segment = segments[findByTick(tick, hint)];
+        double beats = (tick - segment.tick) / mPPQN;
+        if (segment.acceleration == 0.0) {
+            return segment.seconds + 60.0 * beats / segment.bpm;
+        }
+        // solves beats = (bpm * t + acceleration * t^2 / 2) / 60 for t, in the form that stays
+        // stable when the acceleration is tiny
+        double root = sqrt(std::max(0.0, segment.bpm * segment.bpm + 2.0 * segment.acceleration * 60.0 * beats));
+        return segment.seconds + 120.0 * beats / (segment.bpm + root);
+    }
+
+    double tickAtSeconds(double seconds, size_t &hint) const {
+        const Segment &segment = segments[findBySeconds(seconds, hint)];
+        double t = seconds - segment.seconds;
+        double beats = (segment.bpm * t + 0.5 * segment.acceleration * t * t) / 60.0;
+        return segment.tick + beats * mPPQN;
+    }
+
+    double tempoAtSeconds(double seconds, size_t &hint) const {
+        const Segment &segment = segments[findBySeconds(seconds, hint)];
+        return segment.bpm + segment.acceleration * (seconds - segment.seconds);
+    }
+
+private:
+    struct Segment {
+        int64_t tick;
+        double seconds;
+        // tempo at the start of the segment
+        double bpm;
+        // change of tempo in bpm per second, 0 for constant segments
+        double acceleration;
+    };
+
+    size_t findByTick(double tick, size_t &hint) const {
+        if (!(hint < segments.size() && segments[hint].tick <= tick && (hint + 1 == segments.size() || tick < segments[hint + 1].tick))) {
+            auto it = std::upper_bound(segments.begin(), segments.end(), tick, [](double tick, const Segment &segment) {
+                return tick < segment.tick;
+            });
+            hint = it == segments.begin() ? 0 : (it - segments.begin()) - 1;
+        }
+        return hint;
+    }
+
+    size_t findBySeconds(double seconds, size_t &hint) const {
+        if (!(hint < segments.size() && segments[hint].seconds <= seconds && (hint + 1 == segments.size() || seconds < segments[hint + 1].seconds))) {
+            auto it = std::upper_bound(segments.begin(), segments.end(), seconds, [](double seconds, const Segment &segment) {
+                return seconds < segment.seconds;
+            });
+            hint = it == segments.begin() ? 0 : (it - segments.begin()) - 1;
+        }
+        return hint;
+    }
+
+    std::vector<Segment> segments;
+    int64_t mPPQN;
+};
+
+#endif
@@ -0,0 +1,93 @@
+//
+//  TransportTelemetry.hpp
+//  AUv3SequencerExample
+//
+//  Created by rumori on 2026. 10. 17..
+//
+
+#pragma once
+
+#ifdef __cplusplus
+
+#import <atomic>
+#import <math.h>
+#import <stdint.h>
+
+// The state of the transport at the start of a render buffer
+struct TransportSnapshot {
+    // position within the loop, in beats
+    double beatPosition = 0.0;
+    // loop length in beats, 0 when the position does not wrap
+    double loopLength = 0.0;
+    double sampleTime = 0.0;
+    // host time of the buffer, 0 when the host did not provide one
+    uint64_t hostTime = 0;
+    double tempo = 120.0;
+    bool playing = false;
+    // the bank index of the playing pattern
+    uint32_t pattern = 0;
+
+    // The position `seconds` after the snapshot was taken, assuming the tempo holds.
+    // Good enough to animate a playhead between buffers, the next snapshot corrects any drift.
+    double beatPositionAfter(double seconds) const {
+        double beat = beatPosition;
+        if (playing && seconds > 0.0) {
+            beat += seconds * tempo / 60.0;
+        }
+        if (loopLength > 0.0) {
+            beat = fmod(beat, loopLength);
+        }
+        return beat;
+    }
+};
+
+// Hands the transport state from the render thread to the UI once per buffer, without messaging.
+// The render thread writes under a sequence counter that is odd while a write is in progress,
+// readers retry until they see the same even count before and after copying.
+class TransportTelemetry {
+public:
+    // render thread, never blocks
+    void write(const TransportSnapshot &snapshot) {
+        uint64_t sequence = mSequence.load(std::memory_order_relaxed);
+        mSequence.store(sequence + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        mBeatPosition.store(snapshot.beatPosition, std::memory_order_relaxed);
+        mLoopLength.store(snapshot.loopLength, std::memory_order_relaxed);
+        mSampleTime.store(snapshot.sampleTime, std::memory_order_relaxed);
+        mHostTime.store(snapshot.hostTime, std::memory_order_relaxed);
+        mTempo.store(snapshot.tempo, std::memory_order_relaxed);
+        mPlaying.store(snapshot.playing, std::memory_order_relaxed);
+        mPattern.store(snapshot.pattern, std::memory_order_relaxed);
+        mSequence.store(sequence + 2, std::memory_order_release);
+    }
+
+    // any thread, returns false if no buffer has been rendered yet
+    bool read(TransportSnapshot &snapshot) const {
+        while (true) {
+            uint64_t before = mSequence.load(std::memory_order_acquire);
+            if (before == 0) return false;
+            if (before & 1) continue;
+            snapshot.beatPosition = mBeatPosition.load(std::memory_order_relaxed);
+            snapshot.loopLength = mLoopLength.load(std::memory_order_relaxed);
+            snapshot.sampleTime = mSampleTime.load(std::memory_order_relaxed);
+            snapshot.hostTime = mHostTime.load(std::memory_order_relaxed);
+            snapshot.tempo = mTempo.load(std::memory_order_relaxed);
+            snapshot.playing = mPlaying.load(std::memory_order_relaxed);
+            snapshot.pattern = mPattern.load(std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if (mSequence.load(std::memory_order_relaxed) == before) return true;
+        }
+    }
+
+private:
+    std::atomic<uint64_t> mSequence { 0 };
+    std::atomic<double> mBeatPosition { 0.0 };
+    std::atomic<double> mLoopLength { 0.0 };
+    std::atomic<double> mSampleTime { 0.0 };
+    std::atomic<uint64_t> mHostTime { 0 };
+    std::atomic<double> mTempo { 120.0 };
+    std::atomic<bool> mPlaying { false };
+    std::atomic<uint32_t> mPattern { 0 };
+};
+
+#endif
@@ -0,0 +1,167 @@
+//
+//  UMPReader.hpp
+//  AUv3SequencerExample
+//
+//  Created by rumori on 2026. 10. 17..
+//
+
+#pragma once
+
+#import <CoreMIDI/CoreMIDI.h>
+
+#ifdef __cplusplus
+
+#import <stdint.h>
+
+// Channel voice opcodes, the high nibble of a MIDI 1.0 status byte and of a MIDI 2.0 channel voice message
+enum UMPOpcode : uint8_t {
+    UMPRegisteredPerNoteController = 0x0,
+    UMPAssignablePerNoteController = 0x1,
+    UMPPerNotePitchBend = 0x6,
+    UMPNoteOff = 0x8,
+    UMPNoteOn = 0x9,
+    UMPPolyPressure = 0xA,
+    UMPControlChange = 0xB,
+    UMPProgramChange = 0xC,
+    UMPChannelPressure = 0xD,
+    UMPPitchBend = 0xE,
+    UMPPerNoteManagement = 0xF,
+};
+
+// A channel voice message at MIDI 2.0 resolution, whether it arrived as MIDI 1.0 or MIDI 2.0.
+// MIDI 1.0 values are scaled up the way the MIDI 2.0 specification translates them.
+struct UMPMessage {
+    uint8_t group = 0;
+    uint8_t opcode = 0;
+    uint8_t channel = 0;
+    // note number, or controller index for control changes
+    uint8_t index = 0;
+    // per-note controller index, or attribute type for notes
+    uint8_t detail = 0;
+    uint16_t velocity = 0;
+    uint16_t attribute = 0;
+    // 32-bit data of pressure, controller and pitch bend messages
+    uint32_t value = 0;
+
+    // from a MIDI 1.0 status byte and its data bytes
+    static UMPMessage fromMIDI1(uint8_t group, uint8_t status, uint8_t data1, uint8_t data2) {
+        UMPMessage message;
+        message.group = group;
+        message.opcode = status >> 4;
+        message.channel = status & 0x0F;
+        message.index = data1 & 0x7F;
+        switch (message.opcode) {
+            case UMPNoteOn:
+                // a MIDI 1.0 note on with velocity 0 is a note off
+                if ((data2 & 0x7F) == 0) message.opcode = UMPNoteOff;
+                [[fallthrough]];
+            case UMPNoteOff:
+                message.velocity = (uint16_t)scaleUp(data2 & 0x7F, 7, 16);
+                break;
+            case UMPPolyPressure:
+            case UMPControlChange:
+                message.value = scaleUp(data2 & 0x7F, 7, 32);
+                break;
+            case UMPProgramChange:
+                message.index = 0;
+                message.value = data1 & 0x7F;
+                break;
+            case UMPChannelPressure:
+                message.index = 0;
+                message.value = scaleUp(data1 & 0x7F, 7, 32);
+                break;
+            case UMPPitchBend:
+                message.index = 0;
+                message.value = scaleUp((data1 & 0x7F) | ((data2 & 0x7F) << 7), 14, 32);
+                break;
+        }
+        return message;
+    }
+
+    // min-center-max scaling, keeps 0, the center value and the maximum in place
+    static uint32_t scaleUp(uint32_t value, uint32_t sourceBits, uint32_t destinationBits) {
+        uint32_t scaleBits = destinationBits - sourceBits;
+        uint64_t shifted = (uint64_t)value << scaleBits;
+        uint32_t center = 1u << (sourceBits - 1);
+        if (value <= center) return (uint32_t)shifted;
+        uint32_t repeatBits = sourceBits - 1;
+        uint64_t repeatValue = value & ((1u << repeatBits) - 1);
+        if (scaleBits > repeatBits) {
+            repeatValue <<= scaleBits - repeatBits;
+        } else {
+            repeatValue >>= repeatBits - scaleBits;
+        }
+        while (repeatValue != 0) {
+            shifted |= repeatValue;
+            repeatValue >>= repeatBits;
+        }
+        return (uint32_t)shifted;
+    }
+};
+
+// Walks the Universal MIDI Packets of a MIDIEventList in place, without copying or allocating,
+// and hands every MIDI 1.0 or MIDI 2.0 channel voice message to a callback. Other message types are skipped.
+class UMPReader {
+public:
+    // the number of 32-bit words in a message, from its type in the top nibble of the first word
+    static uint32_t messageWordCount(uint32_t word) {
+        static const uint8_t wordCounts[16] = { 1, 1, 1, 2, 2, 4, 1, 1, 2, 2, 2, 3, 3, 4, 4, 4 };
+        return wordCounts[word >> 28];
+    }
+
+    // Calls `callback(message)` for every channel voice message in `list`.
+    template <typename Callback>
+    static void forEachMessage(const MIDIEventList *list, Callback &&callback) {
+        const MIDIEventPacket *packet = &list->packet[0];
+        for (UInt32 i = 0; i < list->numPackets; i++) {
+            const UInt32 *words = packet->words;
+            const UInt32 wordCount = packet->wordCount;
+            UInt32 position = 0;
+            while (position < wordCount) {
+                uint32_t size = messageWordCount(words[position]);
+                // a truncated message ends the packet
+                if (position + size > wordCount) break;
+                readMessage(words + position, callback);
+                position += size;
+            }
+            packet = MIDIEventPacketNext(packet);
+        }
+    }
+
+private:
+    template <typename Callback>
+    static void readMessage(const UInt32 *words, Callback &&callback) {
+        uint32_t word = words[0];
+        uint8_t type = word >> 28;
+        uint8_t group = (word >> 24) & 0x0F;
+        if (type == 0x2) {
+            // MIDI 1.0 channel voice
+            callback(UMPMessage::fromMIDI1(group, (word >> 16) & 0xFF, (word >> 8) & 0xFF, word & 0xFF));
+        } else if (type == 0x4) {
+            // MIDI 2.0 channel voice, everything at full resolution
+            UMPMessage message;
+            message.group = group;
+            message.opcode = (word >> 20) & 0x0F;
+            message.channel = (word >> 16) & 0x0F;
+            message.index = (word >> 8) & 0x7F;
+            message.detail = word & 0xFF;
+            uint32_t data = words[1];
+            switch (message.opcode) {
+                case UMPNoteOff:
+                case UMPNoteOn:
+                    message.velocity = data >> 16;
+                    message.attribute = data & 0xFFFF;
+                    break;
+                case UMPProgramChange:
+                    message.value = (data >> 24) & 0x7F;
+                    break;
+                default:
+                    message.value = data;
+                    break;
+            }
+            callback(message);
+        }
+    }
+};
+
+#endif
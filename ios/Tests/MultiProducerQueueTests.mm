@@ -0,0 +1,109 @@
+//
+//  MultiProducerQueueTests.mm
+//  AUv3SequencerExample
+//
+//  Created by rumori on 2026. 10. 17..
+//
+//  Pushes into MultiProducerQueue from several threads while another one drains, and checks that every command
+//  arrives once and in its producer's order, and that the statistics never count past the capacity.
+//  Not part of the plugin, build and run it on a Mac from the repository root with
+//
+//    clang++ -std=c++17 -O2 -I ios/Classes -x objective-c++ ios/Tests/MultiProducerQueueTests.mm -o MultiProducerQueueTests
+//    ./MultiProducerQueueTests
+//
+//  Exits with 1 on the first failed check.
+//
+
+#import "MultiProducerQueue.hpp"
+#import <stdio.h>
+#import <stdlib.h>
+#import <thread>
+#import <vector>
+
+static constexpr uint32_t PRODUCERS = 4;
+static constexpr uint32_t COMMANDS_PER_PRODUCER = 200000;
+static constexpr uint32_t CAPACITY = 1024;
+
+struct TestCommand {
+    uint32_t producer;
+    uint32_t sequence;
+};
+
+static void check(bool condition, const char *what) {
+    if (!condition) {
+        printf("FAILED: %s\n", what);
+        exit(1);
+    }
+}
+
+static void testConcurrentStats() {
+    MultiProducerQueue<TestCommand> queue(CAPACITY);
+    std::atomic<uint32_t> running { PRODUCERS };
+    std::vector<std::thread> producers;
+    for (uint32_t producer = 0; producer < PRODUCERS; producer++) {
+        producers.emplace_back([&, producer] {
+            for (uint32_t sequence = 0; sequence < COMMANDS_PER_PRODUCER; sequence++) {
+                while (!queue.tryPush({ producer, sequence })) {
+                    std::this_thread::yield();
+                }
+            }
+            running--;
+        });
+    }
+
+    // the consumer drains while a third party watches the statistics
+    std::vector<uint32_t> next(PRODUCERS, 0);
+    bool inOrder = true;
+    uint32_t maxFill = 0;
+    std::thread consumer([&] {
+        while (running.load() > 0 || queue.ready()) {
+            queue.drain([&](const TestCommand &command) {
+                inOrder = inOrder && command.sequence == next[command.producer];
+                next[command.producer] = command.sequence + 1;
+            });
+        }
+    });
+    while (running.load() > 0) {
+        QueueStats stats = queue.stats();
+        maxFill = std::max(maxFill, stats.fill);
+        check(stats.highWater <= stats.capacity, "high-water mark within capacity while draining");
+    }
+    for (std::thread &thread : producers) thread.join();
+    consumer.join();
+
+    QueueStats stats = queue.stats();
+    check(inOrder, "commands of one producer arrive in order");
+    for (uint32_t producer = 0; producer < PRODUCERS; producer++) {
+        check(next[producer] == COMMANDS_PER_PRODUCER, "every command arrives");
+    }
+    check(maxFill <= stats.capacity, "fill within capacity");
+    check(stats.highWater <= stats.capacity, "high-water mark within capacity");
+    check(stats.pushed == (uint64_t)PRODUCERS * COMMANDS_PER_PRODUCER, "pushed count");
+    check(stats.fill == 0, "empty after the last drain");
+    check(stats.dropped == 0, "failed tries are not drops");
+    printf("concurrent: capacity %u high water %u max fill %u\n", stats.capacity, stats.highWater, maxFill);
+}
+
+static void testFullQueue() {
+    MultiProducerQueue<TestCommand> queue(4);
+    static int callbacks = 0;
+    queue.setSpaceAvailableCallback([](void *) { callbacks++; }, nullptr);
+    for (uint32_t i = 0; i < 4; i++) {
+        check(queue.tryPush({ 0, i }), "push into free room");
+    }
+    check(!queue.tryPush({ 0, 4 }), "try on a full queue fails");
+    check(!queue.push({ 0, 4 }), "push on a full queue fails");
+    QueueStats stats = queue.stats();
+    check(stats.fill == 4 && stats.highWater == 4, "full queue statistics");
+    check(stats.dropped == 1, "only push counts a drop");
+    queue.drain([](const TestCommand &) {});
+    check(callbacks == 1, "a drain after a failed try calls back once");
+    check(queue.stats().fill == 0, "empty after draining");
+    printf("full queue: ok\n");
+}
+
+int main() {
+    testFullQueue();
+    testConcurrentStats();
+    return 0;
+}
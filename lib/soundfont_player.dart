@@ -46,4 +46,12 @@ class SoundfontPlayer {
   Future<void> removeChord(ChordEvent chord) {
     return SoundfontPlayerPlatform.instance.removeChord(chord);
   }
+
+  Future<bool> startRecording(String path) {
+    return SoundfontPlayerPlatform.instance.startRecording(path);
+  }
+
+  Future<void> stopRecording() {
+    return SoundfontPlayerPlatform.instance.stopRecording();
+  }
 }
@@ -74,4 +74,17 @@ class MethodChannelSoundfontPlayer extends SoundfontPlayerPlatform {
   Future<void> removeChord(ChordEvent chord) async {
     await methodChannel.invokeMethod<String>('removeChord', chord.asMap());
   }
+
+  @override
+  Future<bool> startRecording(String path) async {
+    final result = await methodChannel.invokeMethod<bool>('startRecording', <String, dynamic>{
+      'path': path,
+    });
+    return result ?? false;
+  }
+
+  @override
+  Future<void> stopRecording() async {
+    await methodChannel.invokeMethod<void>('stopRecording');
+  }
 }
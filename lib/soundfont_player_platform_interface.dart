@@ -67,4 +67,12 @@ abstract class SoundfontPlayerPlatform extends PlatformInterface {
   Future<void> removeChord(ChordEvent chord) {
     throw UnimplementedError('removeChord() has not been implemented.');
   }
+
+  Future<bool> startRecording(String path) {
+    throw UnimplementedError('startRecording() has not been implemented.');
+  }
+
+  Future<void> stopRecording() {
+    throw UnimplementedError('stopRecording() has not been implemented.');
+  }
 }